@@ -0,0 +1,75 @@
+// Drives many concurrent compute jobs from one host thread with coroutines:
+// every job owns one frame of the ring, fills its inputs, awaits the dispatch
+// and reads the output back, while the reactor thread of async_queue resumes
+// whichever job completed.
+//
+// usage: async_compute_benchmark [iterations per job]
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <string>
+#include <vulkan/vulkan.h>
+#include "compute_app.hpp"
+#include "async_helper.hpp"
+#include "latency_histogram.hpp"
+
+constexpr uint32_t job_count = 64;
+
+using async_compute_app = vulkan_helper::async_queue<ring_compute_app<vulkan_helper::storage_location::host_cached, job_count>>;
+
+class async_compute_benchmark : public async_compute_app {
+public:
+    vulkan_helper::task<> job(vulkan_helper::ring_frame& frame, uint64_t iterations) {
+        auto sizes = async_compute_app::get_storage_buffer_sizes();
+        for (uint64_t i = 0; i < iterations; i++) {
+            for (size_t b = 0; b < sizes.size(); b++) {
+                uint32_t* data = reinterpret_cast<uint32_t*>(frame.host_allocation(b).mapped);
+                for (uint32_t t = 0; t < sizes[b] / sizeof(uint32_t); t++) {
+                    data[t] = t + static_cast<uint32_t>(i);
+                }
+            }
+            auto start = std::chrono::steady_clock::now();
+            auto value = co_await async_compute_app::completion(async_compute_app::submit_frame_commands(frame));
+            m_histogram.record(std::chrono::steady_clock::now() - start);
+            auto bytes = co_await async_compute_app::readback(frame.host_allocation(0), value);
+            for (auto byte : bytes) {
+                m_checksum += static_cast<uint8_t>(byte);
+            }
+        }
+    }
+    void run(uint64_t iterations) {
+        auto begin = std::chrono::steady_clock::now();
+        for (auto& frame : async_compute_app::get_frames()) {
+            async_compute_app::spawn(job(frame, iterations));
+        }
+        async_compute_app::run();
+        auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - begin };
+
+        auto us = [](auto duration) {
+            return std::chrono::duration<double, std::micro>{ duration }.count();
+        };
+        std::cout << std::format("device: {}", async_compute_app::get_properties().deviceName) << std::endl;
+        std::cout << std::format("jobs: {}, dispatches: {}, elapsed: {:.3f} s, throughput: {:.1f} dispatches/s, checksum: {:#x}",
+            job_count, m_histogram.count(), elapsed.count(), m_histogram.count() / elapsed.count(), m_checksum) << std::endl;
+        std::cout << std::format("submit to resume us: mean {:.2f}, p50 {:.2f}, p99 {:.2f}, max {:.2f}",
+            us(m_histogram.mean()), us(m_histogram.percentile(0.5)),
+            us(m_histogram.percentile(0.99)), us(m_histogram.max())) << std::endl;
+    }
+private:
+    latency_histogram m_histogram{};
+    uint64_t m_checksum = 0;
+};
+
+int main(int argc, char** argv) {
+    try {
+        uint64_t iterations = argc > 1 ? std::stoull(argv[1]) : 100;
+        async_compute_benchmark benchmark;
+        benchmark.run(iterations);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "vulkan_helper.hpp"
+
+namespace vulkan_helper {
+    template<class T>
+    class task_promise_result {
+    public:
+        void return_value(T value) {
+            m_value.emplace(std::move(value));
+        }
+        void unhandled_exception() {
+            m_exception = std::current_exception();
+        }
+        T result() {
+            if (m_exception) {
+                std::rethrow_exception(m_exception);
+            }
+            return std::move(*m_value);
+        }
+    private:
+        std::optional<T> m_value;
+        std::exception_ptr m_exception;
+    };
+
+    template<>
+    class task_promise_result<void> {
+    public:
+        void return_void() {}
+        void unhandled_exception() {
+            m_exception = std::current_exception();
+        }
+        void result() {
+            if (m_exception) {
+                std::rethrow_exception(m_exception);
+            }
+        }
+    private:
+        std::exception_ptr m_exception;
+    };
+
+    // Lazily started coroutine. Awaiting it starts it and resumes the awaiter
+    // when it finishes, by symmetric transfer so deep chains don't grow the stack.
+    template<class T = void>
+    class task {
+    public:
+        class promise_type : public task_promise_result<T> {
+        public:
+            task get_return_object() {
+                return task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+            }
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+            auto final_suspend() noexcept {
+                struct final_awaiter {
+                    bool await_ready() noexcept {
+                        return false;
+                    }
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                        return handle.promise().m_continuation;
+                    }
+                    void await_resume() noexcept {}
+                };
+                return final_awaiter{};
+            }
+        private:
+            friend class task;
+            std::coroutine_handle<> m_continuation = std::noop_coroutine();
+        };
+
+        task() = default;
+        task(const task&) = delete;
+        task(task&& other) noexcept : m_handle{ std::exchange(other.m_handle, nullptr) }
+        {}
+        ~task() {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+        }
+        task& operator=(const task&) = delete;
+        task& operator=(task&& other) noexcept {
+            if (this != &other) {
+                if (m_handle) {
+                    m_handle.destroy();
+                }
+                m_handle = std::exchange(other.m_handle, nullptr);
+            }
+            return *this;
+        }
+
+        bool done() const {
+            return !m_handle || m_handle.done();
+        }
+        // runs the coroutine up to its first suspension, for tasks nobody awaits
+        void start() {
+            m_handle.resume();
+        }
+        T result() {
+            return m_handle.promise().result();
+        }
+
+        auto operator co_await() noexcept {
+            struct awaiter {
+                std::coroutine_handle<promise_type> handle;
+                bool await_ready() noexcept {
+                    return !handle || handle.done();
+                }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+                    handle.promise().m_continuation = continuation;
+                    return handle;
+                }
+                T await_resume() {
+                    return handle.promise().result();
+                }
+            };
+            return awaiter{ m_handle };
+        }
+    private:
+        explicit task(std::coroutine_handle<promise_type> handle) : m_handle{ handle }
+        {}
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    // Awaitable interface over D's timeline semaphore. A reactor thread blocks on
+    // the semaphore and moves coroutines whose value was reached to a ready
+    // queue; run() resumes them on the calling thread, so coroutine bodies never
+    // run concurrently and need no locking. Values of one queue complete in
+    // order, so the reactor always waits for the next value after the last one
+    // it saw and wakes once per completion.
+    template<class D>
+    class async_queue : public D {
+    public:
+        async_queue() : m_reactor{ [this] { reactor_loop(); } }
+        {}
+        async_queue(const async_queue&) = delete;
+        async_queue(async_queue&&) = delete;
+        ~async_queue() {
+            {
+                std::lock_guard lock{ m_mutex };
+                m_stop = true;
+            }
+            m_pending_cv.notify_one();
+            m_reactor.join();
+        }
+        async_queue& operator=(const async_queue&) = delete;
+        async_queue& operator=(async_queue&&) = delete;
+
+        class timeline_awaitable {
+        public:
+            timeline_awaitable(async_queue& queue, uint64_t value) : m_queue{ queue }, m_value{ value }
+            {}
+            bool await_ready() {
+                return m_queue.is_completed(m_value);
+            }
+            void await_suspend(std::coroutine_handle<> handle) {
+                m_queue.resume_when_completed(m_value, handle);
+            }
+            uint64_t await_resume() const {
+                return m_value;
+            }
+        private:
+            async_queue& m_queue;
+            uint64_t m_value;
+        };
+
+        // resumes once the given timeline value has been reached
+        timeline_awaitable completion(uint64_t value) {
+            return timeline_awaitable{ *this, value };
+        }
+        // submits right away and resumes with the submission's timeline value once it completed
+        timeline_awaitable submit_async(VkCommandBuffer command_buffer, uint64_t wait_value = 0) {
+            return timeline_awaitable{ *this, D::submit_timeline(command_buffer, wait_value) };
+        }
+        // resumes once the submission that wrote the allocation completed, with
+        // the allocation invalidated and readable
+        task<std::span<const std::byte>> readback(const memory_allocation& allocation, uint64_t value) {
+            co_await completion(value);
+            if (D::is_non_coherent(allocation.memory_type_index)) {
+                D::invalidate_mapped_memory_ranges(allocation.memory, allocation.offset, allocation.size);
+            }
+            co_return std::span<const std::byte>{ static_cast<const std::byte*>(allocation.mapped), static_cast<size_t>(allocation.size) };
+        }
+
+        // starts the task now; run() keeps it alive until it finished
+        void spawn(task<> job) {
+            job.start();
+            m_jobs.emplace_back(std::move(job));
+        }
+        // resumes ready coroutines on this thread until every spawned task finished,
+        // rethrows the first exception of a task or the reactor
+        void run() {
+            while (true) {
+                for (auto& job : m_jobs) {
+                    if (job.done()) {
+                        job.result();
+                    }
+                }
+                std::erase_if(m_jobs, [](const auto& job) { return job.done(); });
+                if (m_jobs.empty()) {
+                    return;
+                }
+                std::coroutine_handle<> handle;
+                {
+                    std::unique_lock lock{ m_mutex };
+                    m_ready_cv.wait(lock, [this] { return !m_ready.empty() || m_reactor_exception; });
+                    if (m_reactor_exception) {
+                        std::rethrow_exception(m_reactor_exception);
+                    }
+                    handle = m_ready.front();
+                    m_ready.pop_front();
+                }
+                handle.resume();
+            }
+        }
+    private:
+        void resume_when_completed(uint64_t value, std::coroutine_handle<> handle) {
+            {
+                std::lock_guard lock{ m_mutex };
+                if (value <= m_reached_value) {
+                    m_ready.push_back(handle);
+                    m_ready_cv.notify_one();
+                    return;
+                }
+                m_pending.emplace(value, handle);
+            }
+            m_pending_cv.notify_one();
+        }
+        void reactor_loop() {
+            auto semaphore = D::get_timeline_semaphore();
+            std::unique_lock lock{ m_mutex };
+            while (true) {
+                m_pending_cv.wait(lock, [this] { return m_stop || !m_pending.empty(); });
+                if (m_stop) {
+                    return;
+                }
+                // every pending value was submitted, so the next one is too
+                auto next_value = m_reached_value + 1;
+                lock.unlock();
+                uint64_t reached_value;
+                try {
+                    D::wait_for_semaphore(semaphore, next_value);
+                    reached_value = D::get_semaphore_counter_value(semaphore);
+                }
+                catch (...) {
+                    lock.lock();
+                    m_reactor_exception = std::current_exception();
+                    m_ready_cv.notify_one();
+                    return;
+                }
+                lock.lock();
+                m_reached_value = reached_value;
+                auto last = m_pending.upper_bound(reached_value);
+                for (auto ite = m_pending.begin(); ite != last; ++ite) {
+                    m_ready.push_back(ite->second);
+                }
+                m_pending.erase(m_pending.begin(), last);
+                m_ready_cv.notify_one();
+            }
+        }
+
+        std::mutex m_mutex;
+        std::condition_variable m_pending_cv;
+        std::condition_variable m_ready_cv;
+        std::multimap<uint64_t, std::coroutine_handle<>> m_pending;
+        std::deque<std::coroutine_handle<>> m_ready;
+        uint64_t m_reached_value = 0;
+        bool m_stop = false;
+        std::exception_ptr m_reactor_exception;
+        std::vector<task<>> m_jobs;
+        std::thread m_reactor;
+    };
+}
@@ -0,0 +1,182 @@
+// Wall time per job of a chain of commands, a job being a clear of an output
+// slice and one dispatch of test.comp repacking into it: each job in a
+// command buffer of its own, submitted and waited for, against all jobs in
+// one command_batch. The batch goes in twice, with every clear right before
+// its dispatch, which takes a barrier per job, and with the clears first,
+// where one barrier covers every slice. The barriers recorded are printed
+// along, and the output of each way is checked against the bit_repack CPU
+// reference.
+//
+// usage: batch_benchmark [iterations]
+#include <stdexcept>
+#include <iostream>
+#include <array>
+#include <chrono>
+#include <format>
+#include <numeric>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vulkan/vulkan.h>
+#include "compute_app.hpp"
+#include "command_batch.hpp"
+#include "bit_repack.hpp"
+#include "latency_histogram.hpp"
+
+// one workgroup of test.comp per slice, as in descriptor_binding_benchmark
+constexpr uint32_t slice_elements = 256;
+constexpr uint32_t job_count = vulkan_helper::descriptor_binder<compute_queue>::default_capacity;
+constexpr uint32_t element_count = slice_elements * job_count;
+constexpr VkDeviceSize slice_size = slice_elements * sizeof(uint16_t);
+
+enum class job_order {
+    submit_per_job,
+    interleaved,
+    clears_first,
+};
+
+std::string_view to_string(job_order order) {
+    switch (order) {
+    case job_order::submit_per_job:
+        return "submit per job";
+    case job_order::interleaved:
+        return "batch interleaved";
+    case job_order::clears_first:
+        return "batch clears first";
+    }
+    return "unknown";
+}
+
+using app_parent = descriptor_binding_app_parent<vulkan_helper::descriptor_mode::push_descriptor, repack_atomic_kernel, element_count>;
+
+class batch_benchmark : public app_parent {
+public:
+    batch_benchmark() {
+        auto buffers = app_parent::get_storage_buffers();
+        for (uint32_t i = 0; i < job_count; i++) {
+            m_slices.push_back({
+                VkDescriptorBufferInfo{ buffers[0], i * slice_size, slice_size },
+                VkDescriptorBufferInfo{ buffers[1], i * slice_size, slice_size } });
+        }
+        for (uint32_t i = 0; i < job_count; i++) {
+            m_single_jobs.push_back(make_batch(i, 1, job_order::submit_per_job));
+        }
+        m_interleaved = make_batch(0, job_count, job_order::interleaved);
+        m_clears_first = make_batch(0, job_count, job_order::clears_first);
+    }
+    // runs every job the given way, returns the barriers recorded for them
+    vulkan_helper::batch_statistics run(job_order order) {
+        if (order == job_order::interleaved) {
+            return submit_and_wait(m_interleaved);
+        }
+        if (order == job_order::clears_first) {
+            return submit_and_wait(m_clears_first);
+        }
+        auto total = vulkan_helper::batch_statistics{};
+        for (auto& batch : m_single_jobs) {
+            auto statistics = submit_and_wait(batch);
+            total.command_count += statistics.command_count;
+            total.dependency_count += statistics.dependency_count;
+            total.buffer_barrier_count += statistics.buffer_barrier_count;
+            total.memory_barrier_count += statistics.memory_barrier_count;
+        }
+        return total;
+    }
+    // runs the jobs over random input and an output the clears have to overwrite
+    size_t count_mismatches(job_order order) {
+        auto allocations = app_parent::get_storage_allocations();
+        auto out = static_cast<std::byte*>(allocations[0].mapped);
+        auto in = static_cast<uint16_t*>(allocations[1].mapped);
+        auto random = std::mt19937{ 1 };
+        std::fill(out, out + element_count * sizeof(uint16_t), std::byte{ 0xff });
+        std::generate(in, in + element_count, [&random] { return static_cast<uint16_t>(random()); });
+        run(order);
+
+        auto expected = std::vector<std::byte>(element_count * sizeof(uint16_t));
+        for (uint32_t i = 0; i < job_count; i++) {
+            bit_repack::repack(std::span{ in + i * slice_elements, slice_elements },
+                std::span{ expected }.subspan(i * slice_size, slice_size));
+        }
+        return std::inner_product(expected.begin(), expected.end(), out, size_t{ 0 },
+            std::plus<>{}, [](std::byte lhs, std::byte rhs) { return size_t{ lhs != rhs }; });
+    }
+    void report(job_order order, uint64_t iterations) {
+        auto mismatches = count_mismatches(order);
+        auto statistics = vulkan_helper::batch_statistics{};
+        latency_histogram latency{};
+        for (uint64_t i = 0; i < iterations; i++) {
+            auto start = std::chrono::steady_clock::now();
+            statistics = run(order);
+            latency.record(std::chrono::steady_clock::now() - start);
+        }
+        auto us = std::chrono::duration<double, std::micro>{ latency.percentile(0.5) }.count() / job_count;
+        std::cout << std::format("{:>18}: {:.2f} us/job, {} barrier(s) holding {} buffer and {} memory barrier(s), {}",
+            to_string(order), us, statistics.dependency_count, statistics.buffer_barrier_count, statistics.memory_barrier_count,
+            mismatches == 0 ? std::string{ "matches cpu reference" } : std::format("{} mismatching byte(s)", mismatches)) << std::endl;
+    }
+private:
+    // the jobs [first, first + count) and the host read of their results
+    vulkan_helper::command_batch make_batch(uint32_t first, uint32_t count, job_order order) {
+        auto buffers = app_parent::get_storage_buffers();
+        auto out = buffers[0];
+        auto in = buffers[1];
+        vulkan_helper::command_batch batch;
+        auto clear = [&](uint32_t i) {
+            batch.fill_buffer(out, i * slice_size, slice_size, 0);
+        };
+        auto repack = [&](uint32_t i) {
+            batch.dispatch(app_parent::get_pipeline(), 1, 1, 1,
+                { vulkan_helper::shader_read_write(out, i * slice_size, slice_size),
+                  vulkan_helper::shader_read(in, i * slice_size, slice_size) },
+                [this, i](vulkan_helper::command_recorder& recorder) {
+                    app_parent::bind_storage_buffers(recorder, VK_PIPELINE_BIND_POINT_COMPUTE,
+                        app_parent::get_pipeline_layout(), m_slices[i]);
+                });
+        };
+        for (uint32_t i = first; i < first + count; i++) {
+            clear(i);
+            if (order != job_order::clears_first) {
+                repack(i);
+            }
+        }
+        if (order == job_order::clears_first) {
+            for (uint32_t i = first; i < first + count; i++) {
+                repack(i);
+            }
+        }
+        batch.prepare({ vulkan_helper::host_read(out, first * slice_size, count * slice_size) });
+        return batch;
+    }
+    vulkan_helper::batch_statistics submit_and_wait(const vulkan_helper::command_batch& batch) {
+        app_parent::reset_command_pool(app_parent::get_command_pool());
+        app_parent::reset_descriptor_bindings();
+        vulkan_helper::command_recorder recorder{ app_parent::get_command_buffer() };
+        recorder.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        auto statistics = batch.record(recorder);
+        recorder.end();
+        app_parent::wait_for_value(app_parent::submit_timeline(app_parent::get_command_buffer()));
+        return statistics;
+    }
+
+    std::vector<std::array<VkDescriptorBufferInfo, 2>> m_slices;
+    std::vector<vulkan_helper::command_batch> m_single_jobs;
+    vulkan_helper::command_batch m_interleaved;
+    vulkan_helper::command_batch m_clears_first;
+};
+
+int main(int argc, char** argv) {
+    try {
+        uint64_t iterations = argc > 1 ? std::stoull(argv[1]) : 100;
+        batch_benchmark benchmark;
+        std::cout << std::format("jobs: {}, {} descriptors, median of {} run(s)",
+            job_count, vulkan_helper::to_string(benchmark.get_descriptor_mode()), iterations) << std::endl;
+        for (auto order : { job_order::submit_per_job, job_order::interleaved, job_order::clears_first }) {
+            benchmark.report(order, iterations);
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BIT_REPACK_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(BIT_REPACK_X86) && (defined(__GNUC__) || defined(__clang__))
+#define BIT_REPACK_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BIT_REPACK_TARGET(isa)
+#endif
+
+// Host reference of test.comp: keeps the low 10 bits of every 16 bit element
+// and writes them as a dense LSB first bit stream, element k landing on bits
+// [10k, 10k + 10) of the destination. On a little endian host that is exactly
+// the uint32_t layout the kernel writes. Destination bits past count * 10 are
+// left untouched, like the kernel's per bit atomics leave them.
+//
+// Four elements always make exactly five bytes, so every tier works on whole
+// groups of four and hands the remaining elements to the scalar code.
+namespace bit_repack {
+    constexpr uint32_t src_stride_bits = 16;
+    constexpr uint32_t dst_stride_bits = 10;
+
+    enum class isa {
+        scalar,
+        // one pext per four elements
+        bmi2,
+        // vpmaddwd/shift merge to 40 bits per qword, vpshufb compaction
+        avx2,
+        // same merge on 512 bits, vpermb compaction and a masked store
+        avx512_vbmi,
+    };
+
+    inline std::string_view to_string(isa level) {
+        switch (level) {
+        case isa::bmi2:
+            return "bmi2";
+        case isa::avx2:
+            return "avx2";
+        case isa::avx512_vbmi:
+            return "avx512_vbmi";
+        default:
+            return "scalar";
+        }
+    }
+
+    constexpr size_t packed_size(size_t count) {
+        return (count * dst_stride_bits + 7) / 8;
+    }
+
+    inline void repack_scalar(const uint16_t* src, size_t count, std::byte* dst) {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            uint64_t bits = 0;
+            for (size_t k = 0; k < 4; k++) {
+                bits |= uint64_t{ src[i + k] & 0x3ffu } << (k * dst_stride_bits);
+            }
+            for (size_t k = 0; k < 5; k++) {
+                dst[i / 4 * 5 + k] = static_cast<std::byte>(bits >> (8 * k));
+            }
+        }
+        // at most 30 bits left, starting on a byte boundary
+        uint64_t bits = 0;
+        size_t bit_count = 0;
+        for (; i < count; i++) {
+            bits |= uint64_t{ src[i] & 0x3ffu } << bit_count;
+            bit_count += dst_stride_bits;
+        }
+        auto out = dst + (count - count % 4) / 4 * 5;
+        for (; bit_count >= 8; bit_count -= 8, bits >>= 8) {
+            *out++ = static_cast<std::byte>(bits);
+        }
+        if (bit_count > 0) {
+            auto keep = static_cast<uint8_t>(0xffu << bit_count);
+            *out = static_cast<std::byte>((static_cast<uint8_t>(*out) & keep) | static_cast<uint8_t>(bits));
+        }
+    }
+
+#ifdef BIT_REPACK_X86
+    BIT_REPACK_TARGET("bmi2")
+    inline void repack_bmi2(const uint16_t* src, size_t count, std::byte* dst) {
+        constexpr uint64_t mask = 0x03ff03ff03ff03ffull;
+        const size_t groups = count / 4;
+        // bytes the output overwrites completely, a trailing partial byte is merged
+        const size_t dst_size = count * dst_stride_bits / 8;
+        size_t g = 0;
+        // the 8 byte store runs 3 bytes ahead, later output overwrites them
+        for (; g < groups && g * 5 + 8 <= dst_size; g++) {
+            uint64_t v;
+            std::memcpy(&v, src + g * 4, sizeof(v));
+            uint64_t bits = _pext_u64(v, mask);
+            std::memcpy(dst + g * 5, &bits, sizeof(bits));
+        }
+        for (; g < groups; g++) {
+            uint64_t v;
+            std::memcpy(&v, src + g * 4, sizeof(v));
+            uint64_t bits = _pext_u64(v, mask);
+            std::memcpy(dst + g * 5, &bits, 5);
+        }
+        repack_scalar(src + groups * 4, count - groups * 4, dst + groups * 5);
+    }
+
+    BIT_REPACK_TARGET("avx2")
+    inline void repack_avx2(const uint16_t* src, size_t count, std::byte* dst) {
+        const size_t blocks = count / 16;
+        const size_t dst_size = count * dst_stride_bits / 8;
+        const __m256i element_mask = _mm256_set1_epi16(0x3ff);
+        // low element * 1 + high element * 1024
+        const __m256i pair_multiplier = _mm256_set1_epi32(0x04000001);
+        const __m256i dword_mask = _mm256_set1_epi64x(0xfffff);
+        // bytes 0-4 of both qwords of a lane to bytes 0-9
+        const __m256i compact = _mm256_setr_epi8(
+            0, 1, 2, 3, 4, 8, 9, 10, 11, 12, -1, -1, -1, -1, -1, -1,
+            0, 1, 2, 3, 4, 8, 9, 10, 11, 12, -1, -1, -1, -1, -1, -1);
+        size_t b = 0;
+        // each lane is stored with 16 bytes, 6 past its 10 bytes of output
+        for (; b < blocks && b * 20 + 26 <= dst_size; b++) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + b * 16));
+            v = _mm256_madd_epi16(_mm256_and_si256(v, element_mask), pair_multiplier);
+            v = _mm256_or_si256(_mm256_and_si256(v, dword_mask), _mm256_slli_epi64(_mm256_srli_epi64(v, 32), 20));
+            v = _mm256_shuffle_epi8(v, compact);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + b * 20), _mm256_castsi256_si128(v));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + b * 20 + 10), _mm256_extracti128_si256(v, 1));
+        }
+        repack_scalar(src + b * 16, count - b * 16, dst + b * 20);
+    }
+
+    BIT_REPACK_TARGET("avx512f,avx512bw,avx512vbmi")
+    inline void repack_avx512_vbmi(const uint16_t* src, size_t count, std::byte* dst) {
+        const size_t blocks = count / 32;
+        const __m512i element_mask = _mm512_set1_epi16(0x3ff);
+        const __m512i pair_multiplier = _mm512_set1_epi32(0x04000001);
+        const __m512i dword_mask = _mm512_set1_epi64(0xfffff);
+        // byte j of the output is byte j % 5 of qword j / 5
+        alignas(64) static constexpr uint8_t compact_indices[64] = {
+             0,  1,  2,  3,  4,  8,  9, 10, 11, 12, 16, 17, 18, 19, 20, 24,
+            25, 26, 27, 28, 32, 33, 34, 35, 36, 40, 41, 42, 43, 44, 48, 49,
+            50, 51, 52, 56, 57, 58, 59, 60,
+        };
+        const __m512i compact = _mm512_load_si512(compact_indices);
+        const __mmask64 store_mask = (__mmask64{ 1 } << 40) - 1;
+        for (size_t b = 0; b < blocks; b++) {
+            auto v = _mm512_loadu_si512(src + b * 32);
+            v = _mm512_madd_epi16(_mm512_and_si512(v, element_mask), pair_multiplier);
+            v = _mm512_or_si512(_mm512_and_si512(v, dword_mask), _mm512_slli_epi64(_mm512_srli_epi64(v, 32), 20));
+            v = _mm512_permutexvar_epi8(compact, v);
+            _mm512_mask_storeu_epi8(dst + b * 40, store_mask, v);
+        }
+        repack_scalar(src + blocks * 32, count - blocks * 32, dst + blocks * 40);
+    }
+
+#ifdef _MSC_VER
+    inline bool os_saves_state(uint64_t mask) {
+        return (_xgetbv(0) & mask) == mask;
+    }
+#endif
+
+    inline bool is_supported(isa level) {
+        switch (level) {
+        case isa::scalar:
+            return true;
+#if defined(__GNUC__) || defined(__clang__)
+        case isa::bmi2:
+            return __builtin_cpu_supports("bmi2");
+        case isa::avx2:
+            return __builtin_cpu_supports("avx2");
+        case isa::avx512_vbmi:
+            return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vbmi");
+#elif defined(_MSC_VER)
+        case isa::bmi2:
+        case isa::avx2:
+        case isa::avx512_vbmi: {
+            int regs[4];
+            __cpuid(regs, 1);
+            bool osxsave = (regs[2] & (1 << 27)) != 0;
+            __cpuidex(regs, 7, 0);
+            if (level == isa::bmi2) {
+                return (regs[1] & (1 << 8)) != 0;
+            }
+            if (level == isa::avx2) {
+                return osxsave && (regs[1] & (1 << 5)) != 0 && os_saves_state(0x6);
+            }
+            return osxsave && (regs[1] & (1 << 30)) != 0 && (regs[2] & (1 << 1)) != 0 && os_saves_state(0xe6);
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+#else
+    inline bool is_supported(isa level) {
+        return level == isa::scalar;
+    }
+#endif
+
+    inline isa best_supported_isa() {
+        for (auto level : { isa::avx512_vbmi, isa::avx2, isa::bmi2 }) {
+            if (is_supported(level)) {
+                return level;
+            }
+        }
+        return isa::scalar;
+    }
+
+    using repack_function = void (*)(const uint16_t*, size_t, std::byte*);
+
+    inline repack_function get_repack_function(isa level) {
+        if (!is_supported(level)) {
+            throw std::runtime_error{ "bit repack isa not supported on this cpu" };
+        }
+        switch (level) {
+#ifdef BIT_REPACK_X86
+        case isa::bmi2:
+            return repack_bmi2;
+        case isa::avx2:
+            return repack_avx2;
+        case isa::avx512_vbmi:
+            return repack_avx512_vbmi;
+#endif
+        default:
+            return repack_scalar;
+        }
+    }
+
+    inline void repack(std::span<const uint16_t> src, std::span<std::byte> dst, isa level) {
+        if (dst.size() < packed_size(src.size())) {
+            throw std::runtime_error{ "bit repack destination too small" };
+        }
+        get_repack_function(level)(src.data(), src.size(), dst.data());
+    }
+    // picks the widest tier the cpu supports, once
+    inline void repack(std::span<const uint16_t> src, std::span<std::byte> dst) {
+        static const auto function = get_repack_function(best_supported_isa());
+        if (dst.size() < packed_size(src.size())) {
+            throw std::runtime_error{ "bit repack destination too small" };
+        }
+        function(src.data(), src.size(), dst.data());
+    }
+}
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <span>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "vulkan_helper.hpp"
+
+// Many dispatches and copies in one command buffer with only the barriers
+// they need. Every command names the byte ranges of the buffers it reads and
+// writes. A command that reads a range after a write, or writes it after a
+// read or write, waits for those; reads after reads and commands on disjoint
+// ranges get no barrier. The barriers one command needs go into a single
+// vkCmdPipelineBarrier2, and equal barriers on adjacent ranges are merged.
+namespace vulkan_helper {
+    // bytes [offset, offset + size) of buffer, VK_WHOLE_SIZE up to its end
+    struct buffer_access {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = VK_WHOLE_SIZE;
+        VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 access = VK_ACCESS_2_NONE;
+    };
+
+    constexpr VkAccessFlags2 write_access_mask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+        VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+    inline bool is_write_access(VkAccessFlags2 access) {
+        return (access & write_access_mask) != 0;
+    }
+
+    inline buffer_access shader_read(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) {
+        return { buffer, offset, size, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT };
+    }
+    inline buffer_access shader_write(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) {
+        return { buffer, offset, size, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+    }
+    // atomics, and any write of only some bits of a word
+    inline buffer_access shader_read_write(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) {
+        return { buffer, offset, size, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+    }
+    inline buffer_access transfer_read(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) {
+        return { buffer, offset, size, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT };
+    }
+    inline buffer_access transfer_write(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) {
+        return { buffer, offset, size, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT };
+    }
+    // fill and update
+    inline buffer_access clear_write(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) {
+        return { buffer, offset, size, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT };
+    }
+    // the host reading mapped results once the submission completed
+    inline buffer_access host_read(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) {
+        return { buffer, offset, size, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT };
+    }
+
+    struct batch_statistics {
+        uint64_t command_count = 0;
+        // vkCmdPipelineBarrier2 calls, and the barriers in them
+        uint64_t dependency_count = 0;
+        uint64_t buffer_barrier_count = 0;
+        uint64_t memory_barrier_count = 0;
+    };
+
+    // The barriers one command waits on
+    class barrier_batch {
+    public:
+        // more buffer barriers than this go in as one memory barrier, which
+        // drivers handle no slower than a long list of ranges
+        static constexpr size_t max_buffer_barriers = 16;
+
+        // barriers of equal masks on overlapping or adjacent ranges of one
+        // buffer become one
+        void add(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize end,
+            VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access) {
+            // a grown range can reach barriers passed over before
+            auto absorb = [&](const VkBufferMemoryBarrier2& barrier) {
+                auto barrier_end = get_end(barrier.offset, barrier.size);
+                if (barrier.buffer != buffer || offset > barrier_end || barrier.offset > end ||
+                    barrier.srcStageMask != src_stage || barrier.srcAccessMask != src_access ||
+                    barrier.dstStageMask != dst_stage || barrier.dstAccessMask != dst_access) {
+                    return false;
+                }
+                offset = std::min(offset, barrier.offset);
+                end = std::max(end, barrier_end);
+                return true;
+            };
+            while (std::erase_if(m_buffer_barriers, absorb) != 0) {
+            }
+            VkBufferMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+            barrier.srcStageMask = src_stage;
+            barrier.srcAccessMask = src_access;
+            barrier.dstStageMask = dst_stage;
+            barrier.dstAccessMask = dst_access;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = buffer;
+            barrier.offset = offset;
+            barrier.size = get_size(offset, end);
+            m_buffer_barriers.push_back(barrier);
+        }
+        bool empty() const {
+            return m_buffer_barriers.empty();
+        }
+        // records and clears the barriers
+        void record(command_recorder& recorder, batch_statistics& statistics) {
+            if (m_buffer_barriers.empty()) {
+                return;
+            }
+            statistics.dependency_count++;
+            if (m_buffer_barriers.size() > max_buffer_barriers) {
+                VkMemoryBarrier2 barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+                for (auto& buffer_barrier : m_buffer_barriers) {
+                    barrier.srcStageMask |= buffer_barrier.srcStageMask;
+                    barrier.srcAccessMask |= buffer_barrier.srcAccessMask;
+                    barrier.dstStageMask |= buffer_barrier.dstStageMask;
+                    barrier.dstAccessMask |= buffer_barrier.dstAccessMask;
+                }
+                recorder.pipeline_barrier(std::span{ &barrier, 1 }, {});
+                statistics.memory_barrier_count++;
+            }
+            else {
+                recorder.pipeline_barrier({}, m_buffer_barriers);
+                statistics.buffer_barrier_count += m_buffer_barriers.size();
+            }
+            m_buffer_barriers.clear();
+        }
+        static VkDeviceSize get_end(VkDeviceSize offset, VkDeviceSize size) {
+            return size == VK_WHOLE_SIZE ? std::numeric_limits<VkDeviceSize>::max() : offset + size;
+        }
+        static VkDeviceSize get_size(VkDeviceSize offset, VkDeviceSize end) {
+            return end == std::numeric_limits<VkDeviceSize>::max() ? VK_WHOLE_SIZE : end - offset;
+        }
+    private:
+        std::vector<VkBufferMemoryBarrier2> m_buffer_barriers;
+    };
+
+    // The state of every buffer range since the start of the command buffer,
+    // in ranges of equal state. Whatever came before the command buffer is
+    // taken as waited for by the submission.
+    class buffer_access_tracker {
+    public:
+        // adds the barriers access needs to barriers. A barrier that makes a
+        // write available also takes in the other ranges of the buffer holding
+        // writes of the same stages, so that a chain of dispatches over the
+        // slices of a buffer waits for the writes before it all at once.
+        void add_barriers(const buffer_access& access, barrier_batch& barriers) {
+            auto end = barrier_batch::get_end(access.offset, access.size);
+            if (end <= access.offset) {
+                return;
+            }
+            auto& ranges = m_buffers[access.buffer];
+            cover(ranges, access.offset, end);
+            bool write = is_write_access(access.access);
+            for (auto it = ranges.lower_bound(access.offset); it != ranges.end() && it->first < end; ++it) {
+                auto& state = it->second;
+                bool visible = is_visible(state, access.stage, access.access);
+                auto src_stage = visible ? VkPipelineStageFlags2{ 0 } : state.write_stages;
+                auto src_access = visible ? VkAccessFlags2{ 0 } : state.write_accesses;
+                if (write) {
+                    // a write after reads only has to wait for them to finish
+                    src_stage |= state.read_stages;
+                }
+                if (src_stage == 0) {
+                    continue;
+                }
+                auto dst_access = src_access != 0 ? access.access : VkAccessFlags2{ 0 };
+                barriers.add(access.buffer, it->first, state.end, src_stage, src_access, access.stage, dst_access);
+                if (src_access != 0) {
+                    make_visible(ranges, access.buffer, src_stage, src_access, access.stage, dst_access, barriers);
+                }
+            }
+        }
+        // the access done, once the barriers it needed were recorded
+        void track(const buffer_access& access) {
+            auto end = barrier_batch::get_end(access.offset, access.size);
+            if (end <= access.offset) {
+                return;
+            }
+            auto& ranges = m_buffers[access.buffer];
+            cover(ranges, access.offset, end);
+            bool write = is_write_access(access.access);
+            for (auto it = ranges.lower_bound(access.offset); it != ranges.end() && it->first < end; ++it) {
+                auto& state = it->second;
+                if (write) {
+                    state = range_state{ state.end, access.stage, access.access & write_access_mask };
+                    continue;
+                }
+                if (state.write_stages != 0) {
+                    state.visible_stages |= access.stage;
+                    state.visible_accesses |= access.access;
+                }
+                state.read_stages |= access.stage;
+            }
+            coalesce(ranges, access.offset, end);
+        }
+        void reset() {
+            m_buffers.clear();
+        }
+        size_t get_range_count() const {
+            size_t count = 0;
+            for (auto& [buffer, ranges] : m_buffers) {
+                count += ranges.size();
+            }
+            return count;
+        }
+    private:
+        struct range_state {
+            VkDeviceSize end = 0;
+            // the last write
+            VkPipelineStageFlags2 write_stages = 0;
+            VkAccessFlags2 write_accesses = 0;
+            // what a barrier made the last write visible to already
+            VkPipelineStageFlags2 visible_stages = 0;
+            VkAccessFlags2 visible_accesses = 0;
+            // stages that read since the last write
+            VkPipelineStageFlags2 read_stages = 0;
+
+            bool same_as(const range_state& other) const {
+                return write_stages == other.write_stages && write_accesses == other.write_accesses &&
+                    visible_stages == other.visible_stages && visible_accesses == other.visible_accesses &&
+                    read_stages == other.read_stages;
+            }
+        };
+        // by range offset
+        using range_map = std::map<VkDeviceSize, range_state>;
+
+        // stages and accesses are each matched as a whole set; every access
+        // flag belongs to only a few stages, so no pair slips through
+        static bool is_visible(const range_state& state, VkPipelineStageFlags2 stage, VkAccessFlags2 access) {
+            return state.write_stages == 0 ||
+                ((state.visible_stages & stage) == stage && (state.visible_accesses & access) == access);
+        }
+        // the barrier waits for every earlier command of src_stage, it only
+        // has to cover the buffer's other ranges written by those stages
+        static void make_visible(range_map& ranges, VkBuffer buffer,
+            VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access,
+            barrier_batch& barriers) {
+            for (auto& [offset, state] : ranges) {
+                if (state.write_stages == 0 || (state.write_stages & ~src_stage) != 0 || (state.write_accesses & ~src_access) != 0 ||
+                    is_visible(state, dst_stage, dst_access)) {
+                    continue;
+                }
+                barriers.add(buffer, offset, state.end, src_stage, src_access, dst_stage, dst_access);
+                state.visible_stages |= dst_stage;
+                state.visible_accesses |= dst_access;
+            }
+        }
+        // splits the range holding position in two there
+        static void split(range_map& ranges, VkDeviceSize position) {
+            auto it = ranges.upper_bound(position);
+            if (it == ranges.begin()) {
+                return;
+            }
+            --it;
+            if (it->first < position && position < it->second.end) {
+                auto tail = it->second;
+                it->second.end = position;
+                ranges.emplace_hint(std::next(it), position, tail);
+            }
+        }
+        // ranges that start and end exactly at offset and end, and none
+        // missing in between
+        static void cover(range_map& ranges, VkDeviceSize offset, VkDeviceSize end) {
+            split(ranges, offset);
+            split(ranges, end);
+            auto cursor = offset;
+            auto it = ranges.lower_bound(offset);
+            while (cursor < end) {
+                if (it == ranges.end() || it->first > cursor) {
+                    auto gap_end = it == ranges.end() ? end : std::min(it->first, end);
+                    ranges.emplace_hint(it, cursor, range_state{ gap_end });
+                    cursor = gap_end;
+                }
+                else {
+                    cursor = it->second.end;
+                    ++it;
+                }
+            }
+        }
+        // joins adjacent ranges of equal state from the one before offset on
+        static void coalesce(range_map& ranges, VkDeviceSize offset, VkDeviceSize end) {
+            auto it = ranges.lower_bound(offset);
+            if (it != ranges.begin()) {
+                --it;
+            }
+            while (it != ranges.end() && it->first <= end) {
+                auto next = std::next(it);
+                if (next != ranges.end() && it->second.end == next->first && it->second.same_as(next->second)) {
+                    it->second.end = next->second.end;
+                    ranges.erase(next);
+                }
+                else {
+                    it = next;
+                }
+            }
+        }
+
+        std::map<VkBuffer, range_map> m_buffers;
+    };
+
+    // Commands queued in order and recorded into a command buffer with the
+    // barriers between them. Recording neither begins nor ends the command
+    // buffer, so a batch can sit between timestamps or other commands.
+    class command_batch {
+    public:
+        // bind records the descriptor bindings and push constants of the
+        // dispatch; the pipeline is bound only when it changes
+        void dispatch(VkPipeline pipeline, uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z,
+            std::vector<buffer_access> accesses, std::function<void(command_recorder&)> bind = {}) {
+            m_commands.push_back({ std::move(accesses), pipeline,
+                [=, bind = std::move(bind)](command_recorder& recorder) {
+                    if (bind) {
+                        bind(recorder);
+                    }
+                    recorder.dispatch(group_count_x, group_count_y, group_count_z);
+                } });
+        }
+        void copy_buffer(VkBuffer src, VkDeviceSize src_offset, VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize size) {
+            add({ transfer_read(src, src_offset, size), transfer_write(dst, dst_offset, size) },
+                [=](command_recorder& recorder) {
+                    recorder.copy_buffer(src, src_offset, dst, dst_offset, size);
+                });
+        }
+        void fill_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t data) {
+            add({ clear_write(buffer, offset, size) },
+                [=](command_recorder& recorder) {
+                    recorder.fill_buffer(buffer, offset, size, data);
+                });
+        }
+        // the data is copied into the batch
+        void update_buffer(VkBuffer buffer, VkDeviceSize offset, std::span<const uint32_t> data) {
+            add({ clear_write(buffer, offset, data.size_bytes()) },
+                [=, words = std::vector<uint32_t>(data.begin(), data.end())](command_recorder& recorder) {
+                    recorder.update_buffer(buffer, offset, words);
+                });
+        }
+        // only the barriers for accesses after the batch, such as host_read
+        // of results or a command recorded after it
+        void prepare(std::vector<buffer_access> accesses) {
+            add(std::move(accesses), {});
+        }
+        // any other command
+        void add(std::vector<buffer_access> accesses, std::function<void(command_recorder&)> record) {
+            m_commands.push_back({ std::move(accesses), VK_NULL_HANDLE, std::move(record) });
+        }
+        size_t size() const {
+            return m_commands.size();
+        }
+        void clear() {
+            m_commands.clear();
+        }
+        // the barriers a command needs are taken against the state before
+        // it, so its own accesses never wait on each other
+        batch_statistics record(command_recorder& recorder) const {
+            auto statistics = batch_statistics{};
+            buffer_access_tracker tracker;
+            barrier_batch barriers;
+            VkPipeline bound_pipeline = VK_NULL_HANDLE;
+            for (auto& command : m_commands) {
+                for (auto& access : command.accesses) {
+                    tracker.add_barriers(access, barriers);
+                }
+                barriers.record(recorder, statistics);
+                for (auto& access : command.accesses) {
+                    tracker.track(access);
+                }
+                if (command.pipeline != VK_NULL_HANDLE && command.pipeline != bound_pipeline) {
+                    recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE, command.pipeline);
+                    bound_pipeline = command.pipeline;
+                }
+                if (command.record) {
+                    command.record(recorder);
+                    statistics.command_count++;
+                }
+            }
+            return statistics;
+        }
+    private:
+        struct command {
+            std::vector<buffer_access> accesses;
+            VkPipeline pipeline;
+            std::function<void(command_recorder&)> record;
+        };
+        std::vector<command> m_commands;
+    };
+}
@@ -0,0 +1,983 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "vulkan_helper.hpp"
+#include "spirv_helper.hpp"
+#include "pixel_pack.hpp"
+#include "variable_pack.hpp"
+#include "pattern_fill.hpp"
+
+class first_physical_device : public vulkan_helper::physical_device {
+public:
+    first_physical_device() : physical_device{
+        [](vulkan_helper::instance& instance) {
+            return instance.get_first_physical_device();
+        }
+    }
+    {}
+};
+
+class compute_queue_physical_device : public first_physical_device {
+public:
+    compute_queue_physical_device() : m_queue_topology{ physical_device::find_queue_topology() }
+    {}
+    uint32_t get_compute_queue_family_index() {
+        return m_queue_topology.compute_family;
+    }
+    uint32_t get_transfer_queue_family_index() {
+        return m_queue_topology.transfer_family;
+    }
+    const auto& get_queue_topology() const {
+        return m_queue_topology;
+    }
+private:
+    vulkan_helper::queue_topology m_queue_topology;
+};
+
+// Preferred is the descriptor mode asked for, the device falls back to the
+// best mode below it that it supports, see vulkan_helper::descriptor_binder.
+// BufferDeviceAddress makes storage buffers addressable from kernels, which
+// Vulkan 1.3 devices always support.
+template<vulkan_helper::descriptor_mode Preferred = vulkan_helper::descriptor_mode::descriptor_set, bool BufferDeviceAddress = false>
+class basic_compute_queue_device : public vulkan_helper::device<compute_queue_physical_device> {
+public:
+    basic_compute_queue_device() :
+        device{ [](compute_queue_physical_device& physical_device) {
+        auto& topology = physical_device.get_queue_topology();
+        vulkan_helper::device_create_info info{};
+        info.add_queue_family(topology.compute_family, 1);
+        info.add_queue_family(topology.transfer_family, topology.transfer_queue_index + 1);
+        info.set_descriptor_mode(physical_device.choose_descriptor_mode(Preferred));
+        if (BufferDeviceAddress) {
+            info.enable_buffer_device_address();
+        }
+        return info;
+            }
+    }
+    {}
+};
+
+using compute_queue_device = basic_compute_queue_device<>;
+
+// the compute queue plus the queue uploads go to, which is the compute queue
+// itself only on devices with a single queue
+template<vulkan_helper::descriptor_mode Preferred = vulkan_helper::descriptor_mode::descriptor_set, bool BufferDeviceAddress = false>
+class basic_compute_queue : public basic_compute_queue_device<Preferred, BufferDeviceAddress> {
+public:
+    using queue_device = basic_compute_queue_device<Preferred, BufferDeviceAddress>;
+
+    basic_compute_queue() :
+        m_queue{
+        queue_device::get_device_queue(queue_device::get_compute_queue_family_index(), 0)
+    },
+        m_transfer_queue{
+        queue_device::get_device_queue(queue_device::get_transfer_queue_family_index(),
+            queue_device::get_queue_topology().transfer_queue_index)
+    }
+    {}
+    VkQueue get_queue() {
+        return m_queue;
+    }
+    VkQueue get_transfer_queue() {
+        return m_transfer_queue;
+    }
+private:
+    VkQueue m_queue;
+    VkQueue m_transfer_queue;
+};
+
+using compute_queue = basic_compute_queue<>;
+
+using buffer_address_compute_queue = basic_compute_queue<vulkan_helper::descriptor_mode::descriptor_set, true>;
+
+template<class D>
+class add_compute_command_pool : public vulkan_helper::command_pool<D> {
+public:
+    add_compute_command_pool() :
+        vulkan_helper::command_pool<D>{
+        [](D& device) {
+            return device.create_command_pool(device.get_compute_queue_family_index());
+        }
+    }
+    {}
+};
+
+template<class PD>
+class physical_device_cached_memory_properties : public PD {
+public:
+    physical_device_cached_memory_properties() : 
+        m_memory_properties{
+        PD::get_memory_properties()
+    }
+    {}
+    const auto& get_memory_properties() const {
+        return m_memory_properties;
+    }
+private:
+    VkPhysicalDeviceMemoryProperties m_memory_properties;
+};
+
+// test.comp, one invocation per 16 bit element setting its 10 bits with atomics
+struct repack_atomic_kernel {
+    static constexpr const char* spirv_path = "comp.spv";
+    static uint32_t group_count(uint32_t element_count) {
+        return (element_count + 255) / 256;
+    }
+};
+
+// test_gather.comp, one invocation per output word
+struct repack_gather_kernel {
+    static constexpr const char* spirv_path = "gather.spv";
+    static uint32_t group_count(uint32_t element_count) {
+        auto word_count = (element_count * 10 + 31) / 32;
+        return (word_count + 127) / 128;
+    }
+};
+
+// test_subgroup.comp, one invocation per element, subgroups assemble and
+// store whole output words
+struct repack_subgroup_kernel {
+    static constexpr const char* spirv_path = "subgroup.spv";
+    static constexpr VkSubgroupFeatureFlags subgroup_operations =
+        VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT | VK_SUBGROUP_FEATURE_SHUFFLE_BIT;
+    static constexpr uint32_t preferred_subgroup_size = 32;
+    static uint32_t group_count(uint32_t element_count) {
+        return (element_count + 255) / 256;
+    }
+};
+
+// test_bda.comp, test.comp with its buffers reached through device addresses
+// in push constants instead of a descriptor set
+struct repack_buffer_address_kernel {
+    static constexpr const char* spirv_path = "bda.spv";
+    struct parameters {
+        VkDeviceAddress out_address;
+        VkDeviceAddress in_address;
+        uint32_t element_count;
+    };
+    // without the tail padding, as large as the shader's push constant block
+    static constexpr uint32_t parameters_size = offsetof(parameters, element_count) + sizeof(uint32_t);
+    static uint32_t group_count(uint32_t element_count) {
+        return (element_count + 255) / 256;
+    }
+};
+
+// variable_pack.comp, see variable_pack_pipelines
+struct variable_pack_kernel {
+    static constexpr const char* spirv_path = "variable_pack.spv";
+};
+
+// pattern_generate.comp, see pattern_generator_pipelines
+struct pattern_generator_kernel {
+    static constexpr const char* spirv_path = "pattern_generate.spv";
+};
+
+// pixel_pack.comp, see pixel_pack_pipelines
+struct pixel_pack_kernel {
+    static constexpr const char* spirv_path = "pixel_pack.spv";
+};
+
+// descriptor set layout, pool and push constant ranges taken from the
+// kernel's module instead of being spelled out per app; the interfaces of
+// further kernels sharing the pipeline layout are merged in
+template<class D, class Kernel, class... Kernels>
+class kernel_reflection : public vulkan_helper::shader_reflection<D> {
+public:
+    kernel_reflection() : vulkan_helper::shader_reflection<D>{ reflect() }
+    {}
+private:
+    static spirv_reflection reflect() {
+        auto reflection = reflect_spirv(spirv_file{ Kernel::spirv_path }.words());
+        ((reflection = vulkan_helper::merge_reflections(std::move(reflection),
+            reflect_spirv(spirv_file{ Kernels::spirv_path }.words()))), ...);
+        return reflection;
+    }
+};
+
+// what test.comp moves between its buffers: the low copy_bits of every
+// src_stride_bits wide input element land on dst_stride_bits wide output slots
+struct repack_parameters {
+    uint32_t src_stride_bits = 16;
+    uint32_t dst_stride_bits = 10;
+    uint32_t copy_bits = 10;
+    // workgroup size of specialized pipelines, the generic one keeps 256
+    uint32_t local_size = 256;
+
+    uint32_t element_count(VkDeviceSize input_size) const {
+        check_widths();
+        return static_cast<uint32_t>(input_size * 8 / src_stride_bits);
+    }
+    // throws unless test.comp can run on buffers of these sizes; it has no
+    // bounds check on Out, so every word it writes has to be in the output
+    void check(VkDeviceSize output_size, VkDeviceSize input_size) const {
+        check_widths();
+        auto output_bits = uint64_t{ element_count(input_size) } * dst_stride_bits;
+        if ((output_bits + 31) / 32 * sizeof(uint32_t) > output_size) {
+            throw std::runtime_error{ "repack output buffer too small for the input" };
+        }
+    }
+private:
+    void check_widths() const {
+        if (src_stride_bits == 0 || dst_stride_bits == 0) {
+            throw std::runtime_error{ "repack strides must not be zero" };
+        }
+        if (copy_bits > std::min({ src_stride_bits, dst_stride_bits, 32u })) {
+            throw std::runtime_error{ "repack copy_bits wider than a stride or a word" };
+        }
+        if (local_size == 0) {
+            throw std::runtime_error{ "repack local_size must not be zero" };
+        }
+    }
+};
+
+// test.comp built for any repack_parameters: specialized pipelines have the
+// parameters compiled in, one per parameter set, while the generic pipeline
+// reads them from push constants and serves every width
+template<class D>
+class repack_pipeline_variants : public vulkan_helper::pipeline_variants<D> {
+public:
+    using parent = vulkan_helper::pipeline_variants<D>;
+
+    repack_pipeline_variants() : parent{
+        [](D& device) {
+            return vulkan_helper::shader_module<D>{device, spirv_file{ repack_atomic_kernel::spirv_path }};
+        }
+    }
+    {}
+    VkPipeline get_specialized_pipeline(const repack_parameters& parameters) {
+        return parent::get_pipeline_variant(std::array{ parameters.local_size,
+            parameters.src_stride_bits, parameters.dst_stride_bits, parameters.copy_bits, 0u });
+    }
+    VkPipeline get_generic_pipeline() {
+        auto defaults = repack_parameters{};
+        return parent::get_pipeline_variant(std::array{ defaults.local_size,
+            defaults.src_stride_bits, defaults.dst_stride_bits, defaults.copy_bits, 1u });
+    }
+    void record_repack(vulkan_helper::command_recorder& recorder, VkDescriptorSet descriptor_set,
+        const repack_parameters& parameters, uint32_t element_count, bool specialized) {
+        auto local_size = specialized ? parameters.local_size : repack_parameters{}.local_size;
+        recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE,
+            specialized ? get_specialized_pipeline(parameters) : get_generic_pipeline());
+        recorder.bind_descriptor_set(VK_PIPELINE_BIND_POINT_COMPUTE, D::get_pipeline_layout(), descriptor_set);
+        if (!specialized) {
+            auto values = std::array{ parameters.src_stride_bits, parameters.dst_stride_bits, parameters.copy_bits };
+            recorder.push_constants(D::get_pipeline_layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(values), values.data());
+        }
+        recorder.dispatch((element_count + local_size - 1) / local_size, 1, 1);
+    }
+};
+
+// pattern_generate.comp, which writes an iota, random or constant
+// pattern_fill::pattern into the buffer at binding 0 or 1 of a descriptor set
+template<class D>
+class pattern_generator_pipelines : public vulkan_helper::pipeline_variants<D> {
+public:
+    using parent = vulkan_helper::pipeline_variants<D>;
+    static constexpr uint32_t local_size = 256;
+    // every invocation strides over the buffer, so the grid stays small
+    static constexpr uint32_t max_group_count = 4096;
+
+    pattern_generator_pipelines() : parent{
+        [](D& device) {
+            return vulkan_helper::shader_module<D>{device, spirv_file{ pattern_generator_kernel::spirv_path }};
+        }
+    }
+    {}
+    void record_pattern_generate(vulkan_helper::command_recorder& recorder, VkDescriptorSet descriptor_set,
+        const pattern_fill::pattern& pattern, uint32_t binding, VkDeviceSize word_count) {
+        if (pattern.kind == pattern_fill::pattern_kind::file) {
+            throw std::runtime_error{ "file patterns are not generated on the device" };
+        }
+        if (binding > 1) {
+            throw std::runtime_error{ "pattern generator writes bindings 0 and 1 only" };
+        }
+        if (word_count > UINT32_MAX) {
+            throw std::runtime_error{ "pattern generator buffer larger than 2^32 words" };
+        }
+        recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE, parent::get_pipeline_variant(
+            std::array{ local_size, static_cast<uint32_t>(pattern.kind), binding }));
+        recorder.bind_descriptor_set(VK_PIPELINE_BIND_POINT_COMPUTE, D::get_pipeline_layout(), descriptor_set);
+        auto values = std::array{ pattern.value, pattern_fill::random_key(pattern.seed, 0) };
+        recorder.push_constants(D::get_pipeline_layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(values), values.data());
+        auto group_count = std::clamp<VkDeviceSize>((word_count + local_size - 1) / local_size, 1, max_group_count);
+        recorder.dispatch(static_cast<uint32_t>(group_count), 1, 1);
+    }
+};
+
+template<class D, class Kernel = repack_atomic_kernel>
+class app_pipeline : public vulkan_helper::pipeline<D> {
+public:
+    app_pipeline() : vulkan_helper::pipeline<D>{ 
+        [](D& device) { 
+            return vulkan_helper::shader_module<D>{device, spirv_file{ Kernel::spirv_path }};
+        },
+        [](D& device) -> vulkan_helper::subgroup_size_control {
+            if constexpr (requires { Kernel::subgroup_operations; }) {
+                auto subgroup = device.get_subgroup_properties();
+                if (!subgroup.supports(Kernel::subgroup_operations)) {
+                    throw std::runtime_error{ "subgroup operations not supported in compute shaders" };
+                }
+                return subgroup.choose_size_control(Kernel::preferred_subgroup_size);
+            }
+            else {
+                return {};
+            }
+        }
+    }
+    {}
+};
+
+template<class D>
+class app_pipeline_cache : public vulkan_helper::pipeline_cache<D> {
+public:
+    app_pipeline_cache() : vulkan_helper::pipeline_cache<D>{ "pipeline_cache.bin" }
+    {}
+};
+
+// output and input of the repack kernels, both as large as ElementCount 16 bit elements
+template<class D, uint32_t ElementCount = 256>
+class add_storage_buffer_sizes : public D {
+public:
+    auto get_storage_buffer_sizes() const {
+        return std::vector{ ElementCount*sizeof(uint16_t), ElementCount*sizeof(uint16_t)};
+    }
+    static constexpr uint32_t get_element_count() {
+        return ElementCount;
+    }
+};
+
+template<class D, vulkan_helper::storage_location Location>
+class add_storage_buffer_locations : public D {
+public:
+    auto get_storage_buffer_locations() const {
+        return std::vector(D::get_storage_buffer_sizes().size(), Location);
+    }
+};
+
+template<class D>
+void write_storage_buffer_descriptors(D& device, VkDescriptorSet descriptor_set, const std::vector<VkBuffer>& storage_buffers) {
+    auto buffer_infos = std::vector<VkDescriptorBufferInfo>(storage_buffers.size());
+    std::transform(
+        storage_buffers.begin(),
+        storage_buffers.end(),
+        buffer_infos.begin(),
+        [](auto& buffer) {
+            VkDescriptorBufferInfo buffer_info{};
+            buffer_info.buffer = buffer;
+            buffer_info.offset = 0;
+            buffer_info.range = VK_WHOLE_SIZE;
+            return buffer_info;
+        }
+    );
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = descriptor_set;
+    write.dstArrayElement = 0;
+    write.descriptorCount = buffer_infos.size();
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = buffer_infos.data();
+    device.update_descriptor_set(write);
+}
+
+template<vulkan_helper::storage_location Location, class Kernel = repack_atomic_kernel, uint32_t ElementCount = 256>
+using compute_app_parent =
+    vulkan_helper::add_mapped_memory_ranges<
+    vulkan_helper::add_storage_memory_ptrs<
+    vulkan_helper::add_staging_buffers<
+    vulkan_helper::add_storage_memories<
+    vulkan_helper::add_storage_buffers<
+    vulkan_helper::memory_allocator<
+    add_storage_buffer_locations<
+    add_storage_buffer_sizes<
+    vulkan_helper::timestamp_query_pool<
+    vulkan_helper::command_buffer<
+    add_compute_command_pool<
+    vulkan_helper::fence<
+    vulkan_helper::timeline_semaphore<
+    physical_device_cached_memory_properties<
+    app_pipeline<
+    app_pipeline_cache<
+    vulkan_helper::pipeline_layout<
+    vulkan_helper::descriptor_set<
+    vulkan_helper::descriptor_pool<
+    vulkan_helper::descriptor_set_layout<
+    kernel_reflection<
+    compute_queue, Kernel
+    >>>>>>, Kernel>>>>>>>, ElementCount>, Location>>>>>>>;
+
+template<vulkan_helper::storage_location Location, class Kernel = repack_atomic_kernel, uint32_t ElementCount = 256>
+class basic_compute_app : public compute_app_parent<Location, Kernel, ElementCount> {
+public:
+    using parent = compute_app_parent<Location, Kernel, ElementCount>;
+
+    basic_compute_app()
+    {
+        write_storage_buffer_descriptors(*this, parent::get_descriptor_set(), parent::get_storage_buffers());
+        record_command_buffer();
+    }
+
+    void record_command_buffer() {
+        parent::begin();
+        parent::reset_timestamps();
+        auto upload_region = parent::begin_region("upload");
+        parent::record_staging_uploads();
+        parent::end_region(upload_region);
+        parent::bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE, parent::get_pipeline());
+        parent::bind_descriptor_set(VK_PIPELINE_BIND_POINT_COMPUTE, 
+                parent::get_pipeline_layout(), parent::get_descriptor_set());
+        auto dispatch_region = parent::begin_region("dispatch");
+        parent::dispatch(Kernel::group_count(parent::get_element_count()), 1, 1);
+        parent::end_region(dispatch_region);
+        auto readback_region = parent::begin_region("readback");
+        parent::record_staging_readbacks();
+        parent::end_region(readback_region);
+        parent::end();
+    }
+
+    void submit() {
+        VkCommandBufferSubmitInfo command_buffer_submit_info{};
+        {
+            auto& info = command_buffer_submit_info;
+            info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+            info.commandBuffer = parent::get_command_buffer();
+        }
+        VkSubmitInfo2 submit_info{};
+        {
+            auto& info = submit_info;
+            info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+            info.commandBufferInfoCount = 1;
+            info.pCommandBufferInfos = &command_buffer_submit_info;
+            auto res = vkQueueSubmit2(parent::get_queue(), 1, &submit_info, parent::get_fence());
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{"failed to submit queue"};
+            }
+        }
+    }
+};
+
+using compute_app = basic_compute_app<vulkan_helper::storage_location::host_visible>;
+
+// compute_app_parent without descriptors: storage buffers are created and
+// allocated addressable, and the pipeline layout holds push constants only
+template<vulkan_helper::storage_location Location, uint32_t ElementCount = 256>
+using buffer_address_compute_app_parent =
+    vulkan_helper::add_storage_buffer_addresses<
+    vulkan_helper::add_mapped_memory_ranges<
+    vulkan_helper::add_storage_memory_ptrs<
+    vulkan_helper::add_staging_buffers<
+    vulkan_helper::add_storage_memories<
+    vulkan_helper::add_storage_buffers<
+    vulkan_helper::memory_allocator<
+    add_storage_buffer_locations<
+    add_storage_buffer_sizes<
+    vulkan_helper::timestamp_query_pool<
+    vulkan_helper::command_buffer<
+    add_compute_command_pool<
+    vulkan_helper::timeline_semaphore<
+    physical_device_cached_memory_properties<
+    app_pipeline<
+    app_pipeline_cache<
+    vulkan_helper::pipeline_layout<
+    kernel_reflection<
+    buffer_address_compute_queue, repack_buffer_address_kernel
+    >>>, repack_buffer_address_kernel>>>>>>, ElementCount>, Location>>>>>>>>;
+
+// basic_compute_app with test_bda.comp: the dispatch pushes the buffer
+// addresses instead of binding a descriptor set, so pointing it at other
+// buffers costs 20 bytes of push constants and no descriptor updates
+template<vulkan_helper::storage_location Location, uint32_t ElementCount = 256>
+class basic_buffer_address_compute_app : public buffer_address_compute_app_parent<Location, ElementCount> {
+public:
+    using parent = buffer_address_compute_app_parent<Location, ElementCount>;
+    using kernel = repack_buffer_address_kernel;
+
+    basic_buffer_address_compute_app()
+    {
+        record_command_buffer();
+    }
+
+    void record_command_buffer() {
+        parent::begin();
+        parent::reset_timestamps();
+        auto upload_region = parent::begin_region("upload");
+        parent::record_staging_uploads();
+        parent::end_region(upload_region);
+        parent::bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE, parent::get_pipeline());
+        auto& addresses = parent::get_storage_buffer_addresses();
+        auto parameters = kernel::parameters{ addresses[0], addresses[1], parent::get_element_count() };
+        parent::push_constants(parent::get_pipeline_layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, kernel::parameters_size, &parameters);
+        auto dispatch_region = parent::begin_region("dispatch");
+        parent::dispatch(kernel::group_count(parent::get_element_count()), 1, 1);
+        parent::end_region(dispatch_region);
+        auto readback_region = parent::begin_region("readback");
+        parent::record_staging_readbacks();
+        parent::end_region(readback_region);
+        parent::end();
+    }
+};
+
+// basic_compute_app's kernel with host visible storage buffers bound anew
+// for every dispatch by a descriptor_binder, in the descriptor mode the device
+// settled on for Preferred
+template<vulkan_helper::descriptor_mode Preferred, class Kernel = repack_atomic_kernel, uint32_t ElementCount = 256>
+using descriptor_binding_app_parent =
+    vulkan_helper::add_storage_memories<
+    vulkan_helper::add_storage_buffers<
+    vulkan_helper::memory_allocator<
+    add_storage_buffer_sizes<
+    vulkan_helper::command_buffer<
+    add_compute_command_pool<
+    vulkan_helper::timeline_semaphore<
+    physical_device_cached_memory_properties<
+    app_pipeline<
+    app_pipeline_cache<
+    vulkan_helper::pipeline_layout<
+    vulkan_helper::descriptor_binder<
+    vulkan_helper::descriptor_set_layout<
+    kernel_reflection<
+    basic_compute_queue<Preferred>, Kernel
+    >>>>>, Kernel>>>>>, ElementCount>>>>;
+
+template<vulkan_helper::storage_location Location, uint32_t FrameCount, class Kernel = repack_atomic_kernel, uint32_t ElementCount = 256>
+using ring_compute_app_parent =
+    vulkan_helper::frame_ring<
+    vulkan_helper::memory_allocator<
+    add_storage_buffer_locations<
+    add_storage_buffer_sizes<
+    add_compute_command_pool<
+    vulkan_helper::timeline_semaphore<
+    physical_device_cached_memory_properties<
+    app_pipeline<
+    pattern_generator_pipelines<
+    app_pipeline_cache<
+    vulkan_helper::pipeline_layout<
+    vulkan_helper::descriptor_set_layout<
+    kernel_reflection<
+    compute_queue, Kernel, pattern_generator_kernel
+    >>>>>, Kernel>>>>, ElementCount>, Location>>, FrameCount>;
+
+// same kernel as basic_compute_app, but with FrameCount frames in flight
+template<vulkan_helper::storage_location Location, uint32_t FrameCount, class Kernel = repack_atomic_kernel, uint32_t ElementCount = 256>
+class ring_compute_app : public ring_compute_app_parent<Location, FrameCount, Kernel, ElementCount> {
+public:
+    using parent = ring_compute_app_parent<Location, FrameCount, Kernel, ElementCount>;
+
+    ring_compute_app()
+    {
+        for (auto& frame : parent::get_frames()) {
+            write_storage_buffer_descriptors(*this, frame.descriptor_set, frame.storage_buffers);
+            record_command_buffer(frame);
+        }
+    }
+    ring_compute_app(const ring_compute_app&) = delete;
+    ring_compute_app& operator=(const ring_compute_app&) = delete;
+    ~ring_compute_app() {
+        parent::wait_idle();
+        destroy_pattern_sources();
+    }
+
+    // Storage buffers with a pattern get it written by the device at the start
+    // of every frame instead of by the host: constants with vkCmdFillBuffer,
+    // file patterns up to max_update_size bytes with vkCmdUpdateBuffer, larger
+    // ones copied from a buffer filled once here, and the rest with
+    // pattern_generate.comp. Rerecords every frame, none may be in flight.
+    void set_device_patterns(std::vector<std::optional<pattern_fill::pattern>> patterns) {
+        if (patterns.size() != parent::get_storage_buffer_sizes().size()) {
+            throw std::runtime_error{ "device pattern count does not match storage buffer count" };
+        }
+        auto host_inputs = std::vector<bool>(patterns.size());
+        for (size_t b = 0; b < patterns.size(); b++) {
+            host_inputs[b] = !patterns[b];
+            if (patterns[b]) {
+                pattern_fill::check_pattern(*patterns[b]);
+            }
+        }
+        parent::set_host_inputs(std::move(host_inputs));
+        m_device_patterns = std::move(patterns);
+        destroy_pattern_sources();
+        create_pattern_sources();
+        parent::reset_command_pool(parent::get_command_pool());
+        for (auto& frame : parent::get_frames()) {
+            record_command_buffer(frame);
+        }
+    }
+
+    // recorded once, the frame's command buffer is resubmitted as is
+    void record_command_buffer(const vulkan_helper::ring_frame& frame) {
+        auto recorder = vulkan_helper::command_recorder{ frame.command_buffer };
+        recorder.begin();
+        parent::record_frame_acquires(recorder, frame);
+        record_device_patterns(recorder, frame);
+        auto query_pool = parent::get_timestamp_query_pool();
+        if (parent::has_timestamps()) {
+            recorder.reset_query_pool(query_pool, frame.first_query, 2);
+            recorder.write_timestamp(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, query_pool, frame.first_query);
+        }
+        recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE, parent::get_pipeline());
+        recorder.bind_descriptor_set(VK_PIPELINE_BIND_POINT_COMPUTE,
+                parent::get_pipeline_layout(), frame.descriptor_set);
+        recorder.dispatch(Kernel::group_count(parent::get_element_count()), 1, 1);
+        if (parent::has_timestamps()) {
+            recorder.write_timestamp(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, query_pool, frame.first_query + 1);
+        }
+        parent::record_frame_readbacks(recorder, frame);
+        recorder.end();
+    }
+private:
+    void record_device_patterns(vulkan_helper::command_recorder& recorder, const vulkan_helper::ring_frame& frame) {
+        auto sizes = parent::get_storage_buffer_sizes();
+        bool has_patterns = false;
+        for (uint32_t b = 0; b < m_device_patterns.size(); b++) {
+            if (!m_device_patterns[b]) {
+                continue;
+            }
+            auto& pattern = *m_device_patterns[b];
+            auto word_count = sizes[b] / sizeof(uint32_t);
+            switch (pattern.kind) {
+            case pattern_fill::pattern_kind::constant:
+                recorder.fill_buffer(frame.storage_buffers[b], 0, VK_WHOLE_SIZE, pattern.value);
+                break;
+            case pattern_fill::pattern_kind::file:
+                if (m_pattern_sources[b] != VK_NULL_HANDLE) {
+                    recorder.copy_buffer(m_pattern_sources[b], frame.storage_buffers[b], sizes[b]);
+                }
+                else {
+                    auto words = std::vector<uint32_t>(word_count);
+                    pattern_fill::fill(pattern, words);
+                    recorder.update_buffer(frame.storage_buffers[b], 0, words);
+                }
+                break;
+            default:
+                parent::record_pattern_generate(recorder, frame.descriptor_set, pattern, b, word_count);
+                break;
+            }
+            has_patterns = true;
+        }
+        if (has_patterns) {
+            recorder.memory_barrier(
+                VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        }
+    }
+    // one source buffer per file pattern too large for vkCmdUpdateBuffer, in
+    // the storage's memory so the per frame copy stays on the device; device
+    // local sources are filled through a staging buffer, once
+    void create_pattern_sources() {
+        auto sizes = parent::get_storage_buffer_sizes();
+        m_pattern_sources.assign(sizes.size(), VK_NULL_HANDLE);
+        m_pattern_source_allocations.assign(sizes.size(), vulkan_helper::memory_allocation{});
+        auto staging_buffers = std::vector<VkBuffer>{};
+        auto staging_allocations = std::vector<vulkan_helper::memory_allocation>{};
+        for (size_t b = 0; b < sizes.size(); b++) {
+            auto& pattern = m_device_patterns[b];
+            if (!pattern || pattern->kind != pattern_fill::pattern_kind::file ||
+                sizes[b] <= vulkan_helper::command_recorder::max_update_size) {
+                continue;
+            }
+            m_pattern_sources[b] = parent::create_buffer(parent::get_compute_queue_family_index(), sizes[b],
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+            m_pattern_source_allocations[b] = vulkan_helper::allocate_storage_memory(*this, m_pattern_sources[b], Location);
+            if (m_pattern_source_allocations[b].mapped != nullptr) {
+                write_pattern(*pattern, m_pattern_source_allocations[b], sizes[b]);
+                continue;
+            }
+            auto staging_buffer = parent::create_buffer(parent::get_compute_queue_family_index(), sizes[b],
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+            staging_buffers.push_back(staging_buffer);
+            staging_allocations.push_back(parent::allocate_buffer_memory(staging_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT));
+            write_pattern(*pattern, staging_allocations.back(), sizes[b]);
+        }
+        if (staging_buffers.empty()) {
+            return;
+        }
+        auto command_buffer = parent::allocate_command_buffer(parent::get_command_pool());
+        auto recorder = vulkan_helper::command_recorder{ command_buffer };
+        recorder.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        for (size_t b = 0, s = 0; b < sizes.size(); b++) {
+            if (m_pattern_sources[b] != VK_NULL_HANDLE && m_pattern_source_allocations[b].mapped == nullptr) {
+                recorder.copy_buffer(staging_buffers[s++], m_pattern_sources[b], sizes[b]);
+            }
+        }
+        recorder.end();
+        parent::wait_for_value(parent::submit_timeline(command_buffer));
+        parent::free_command_buffer(parent::get_command_pool(), command_buffer);
+        for (size_t s = 0; s < staging_buffers.size(); s++) {
+            parent::destroy_buffer(staging_buffers[s]);
+            parent::free(staging_allocations[s]);
+        }
+    }
+    void write_pattern(const pattern_fill::pattern& pattern, const vulkan_helper::memory_allocation& allocation, VkDeviceSize size) {
+        pattern_fill::fill(pattern, std::span{ static_cast<uint32_t*>(allocation.mapped), size / sizeof(uint32_t) });
+        if (parent::is_non_coherent(allocation.memory_type_index)) {
+            auto ranges = vulkan_helper::mapped_memory_ranges{};
+            ranges.add(allocation.memory, allocation.offset, allocation.size);
+            parent::flush_mapped_memory_ranges(ranges.merge());
+        }
+    }
+    void destroy_pattern_sources() {
+        for (size_t b = 0; b < m_pattern_sources.size(); b++) {
+            if (m_pattern_sources[b] != VK_NULL_HANDLE) {
+                parent::destroy_buffer(m_pattern_sources[b]);
+                parent::free(m_pattern_source_allocations[b]);
+            }
+        }
+        m_pattern_sources.clear();
+        m_pattern_source_allocations.clear();
+    }
+
+    std::vector<std::optional<pattern_fill::pattern>> m_device_patterns;
+    std::vector<VkBuffer> m_pattern_sources;
+    std::vector<vulkan_helper::memory_allocation> m_pattern_source_allocations;
+};
+
+// pixel_pack.comp for every pixel_pack::format and direction, one pipeline
+// variant per combination. Binding 0 is the packed stream and binding 1 the
+// planar 16 bit containers, whose size sets the pixel count.
+template<class D>
+class pixel_pack_pipelines : public vulkan_helper::pipeline_variants<D> {
+public:
+    using parent = vulkan_helper::pipeline_variants<D>;
+    static constexpr uint32_t local_size = 128;
+
+    pixel_pack_pipelines() : parent{
+        [](D& device) {
+            return vulkan_helper::shader_module<D>{device, spirv_file{ pixel_pack_kernel::spirv_path }};
+        }
+    }
+    {}
+    VkPipeline get_pixel_pack_pipeline(const pixel_pack::format& format, pixel_pack::direction direction) {
+        pixel_pack::check_format(format);
+        return parent::get_pipeline_variant(std::array{ local_size, format.bits, format.channels,
+            uint32_t{ format.order == pixel_pack::bit_order::msb_first },
+            uint32_t{ direction == pixel_pack::direction::unpack } });
+    }
+    void record_pixel_pack(vulkan_helper::command_recorder& recorder, VkDescriptorSet descriptor_set,
+        const pixel_pack::format& format, pixel_pack::direction direction, VkDeviceSize unpacked_size) {
+        recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE, get_pixel_pack_pipeline(format, direction));
+        recorder.bind_descriptor_set(VK_PIPELINE_BIND_POINT_COMPUTE, D::get_pipeline_layout(), descriptor_set);
+        // one invocation per output word
+        auto pixel_count = unpacked_size / sizeof(uint16_t) / format.channels;
+        auto word_count = direction == pixel_pack::direction::pack ?
+            (pixel_count * format.channels * format.bits + 31) / 32 :
+            unpacked_size / sizeof(uint32_t);
+        recorder.dispatch(static_cast<uint32_t>((word_count + local_size - 1) / local_size), 1, 1);
+    }
+};
+
+template<vulkan_helper::storage_location Location, uint32_t ElementCount = 256,
+    template<class> class Pipelines = repack_pipeline_variants, class Kernel = repack_atomic_kernel>
+using repack_engine_parent =
+    vulkan_helper::add_mapped_memory_ranges<
+    vulkan_helper::add_storage_memory_ptrs<
+    vulkan_helper::add_staging_buffers<
+    vulkan_helper::add_storage_memories<
+    vulkan_helper::add_storage_buffers<
+    vulkan_helper::memory_allocator<
+    add_storage_buffer_locations<
+    add_storage_buffer_sizes<
+    vulkan_helper::timestamp_query_pool<
+    vulkan_helper::command_buffer<
+    add_compute_command_pool<
+    vulkan_helper::timeline_semaphore<
+    physical_device_cached_memory_properties<
+    Pipelines<
+    app_pipeline_cache<
+    vulkan_helper::pipeline_layout<
+    vulkan_helper::descriptor_set<
+    vulkan_helper::descriptor_pool<
+    vulkan_helper::descriptor_set_layout<
+    kernel_reflection<
+    compute_queue, Kernel
+    >>>>>>>>>>>>, ElementCount>, Location>>>>>>>;
+
+// basic_compute_app with the repack parameters chosen at run time: record()
+// re-records the command buffer for a parameter set, with its specialized
+// pipeline or with the generic one
+template<vulkan_helper::storage_location Location, uint32_t ElementCount = 256>
+class repack_engine : public repack_engine_parent<Location, ElementCount> {
+public:
+    using parent = repack_engine_parent<Location, ElementCount>;
+
+    repack_engine()
+    {
+        write_storage_buffer_descriptors(*this, parent::get_descriptor_set(), parent::get_storage_buffers());
+    }
+
+    void record(const repack_parameters& parameters, bool specialized) {
+        auto sizes = parent::get_storage_buffer_sizes();
+        parameters.check(sizes[0], sizes[1]);
+        parent::reset_command_pool(parent::get_command_pool());
+        auto recorder = vulkan_helper::command_recorder{ parent::get_command_buffer() };
+        parent::begin();
+        parent::reset_timestamps();
+        auto upload_region = parent::begin_region("upload");
+        parent::record_staging_uploads();
+        parent::end_region(upload_region);
+        auto dispatch_region = parent::begin_region("dispatch");
+        parent::record_repack(recorder, parent::get_descriptor_set(), parameters,
+            parameters.element_count(sizes[1]), specialized);
+        parent::end_region(dispatch_region);
+        auto readback_region = parent::begin_region("readback");
+        parent::record_staging_readbacks();
+        parent::end_region(readback_region);
+        parent::end();
+    }
+};
+
+// pixel_pack.comp on two buffers of ElementCount 16 bit containers, the first
+// holding the packed stream and the second the planar samples
+template<vulkan_helper::storage_location Location, uint32_t ElementCount = 256>
+class pixel_pack_engine : public repack_engine_parent<Location, ElementCount, pixel_pack_pipelines, pixel_pack_kernel> {
+public:
+    using parent = repack_engine_parent<Location, ElementCount, pixel_pack_pipelines, pixel_pack_kernel>;
+
+    pixel_pack_engine()
+    {
+        write_storage_buffer_descriptors(*this, parent::get_descriptor_set(), parent::get_storage_buffers());
+    }
+
+    void record(const pixel_pack::format& format, pixel_pack::direction direction) {
+        parent::reset_command_pool(parent::get_command_pool());
+        auto recorder = vulkan_helper::command_recorder{ parent::get_command_buffer() };
+        parent::begin();
+        parent::reset_timestamps();
+        auto upload_region = parent::begin_region("upload");
+        parent::record_staging_uploads();
+        parent::end_region(upload_region);
+        auto dispatch_region = parent::begin_region("dispatch");
+        parent::record_pixel_pack(recorder, parent::get_descriptor_set(), format, direction,
+            parent::get_storage_buffer_sizes()[1]);
+        parent::end_region(dispatch_region);
+        auto readback_region = parent::begin_region("readback");
+        parent::record_staging_readbacks();
+        parent::end_region(readback_region);
+        parent::end();
+    }
+};
+
+// variable_pack.comp, one pipeline variant per pass. The passes read the codes
+// at binding 1, write the stream to binding 0 and keep the total bit count and
+// the block offsets at binding 2.
+template<class D>
+class variable_pack_pipelines : public vulkan_helper::pipeline_variants<D> {
+public:
+    using parent = vulkan_helper::pipeline_variants<D>;
+    static constexpr uint32_t block_size = 1024;
+    static constexpr VkSubgroupFeatureFlags subgroup_operations =
+        VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+    static constexpr std::array<const char*, 3> pass_names{ "reduce", "scan", "scatter" };
+
+    variable_pack_pipelines() : parent{
+        [](D& device) {
+            if (!device.get_subgroup_properties().supports(subgroup_operations)) {
+                throw std::runtime_error{ "subgroup operations not supported in compute shaders" };
+            }
+            return vulkan_helper::shader_module<D>{device, spirv_file{ variable_pack_kernel::spirv_path }};
+        }
+    }
+    {}
+    static constexpr uint32_t get_block_count(uint32_t element_count) {
+        return (element_count + block_size - 1) / block_size;
+    }
+    void record_variable_pack_pass(vulkan_helper::command_recorder& recorder, VkDescriptorSet descriptor_set,
+        uint32_t pass, uint32_t element_count) {
+        recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE, parent::get_pipeline_variant(std::array{ pass }));
+        recorder.bind_descriptor_set(VK_PIPELINE_BIND_POINT_COMPUTE, D::get_pipeline_layout(), descriptor_set);
+        recorder.dispatch(pass == 1 ? 1 : std::max(get_block_count(element_count), 1u), 1, 1);
+        if (pass + 1 < pass_names.size()) {
+            recorder.memory_barrier(
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        }
+    }
+    void record_variable_pack(vulkan_helper::command_recorder& recorder, VkDescriptorSet descriptor_set, uint32_t element_count) {
+        for (uint32_t pass = 0; pass < pass_names.size(); pass++) {
+            record_variable_pack_pass(recorder, descriptor_set, pass, element_count);
+        }
+    }
+};
+
+// the stream with room for 32 bits per code, the codes, and the total bit
+// count followed by one offset per block
+template<class D, uint32_t ElementCount>
+class add_variable_pack_buffer_sizes : public D {
+public:
+    auto get_storage_buffer_sizes() const {
+        return std::vector{ ElementCount * sizeof(uint32_t), ElementCount * sizeof(variable_pack::code),
+            (1 + D::get_block_count(ElementCount)) * sizeof(uint32_t) };
+    }
+    static constexpr uint32_t get_element_count() {
+        return ElementCount;
+    }
+};
+
+template<vulkan_helper::storage_location Location, uint32_t ElementCount>
+using variable_pack_engine_parent =
+    vulkan_helper::add_mapped_memory_ranges<
+    vulkan_helper::add_storage_memory_ptrs<
+    vulkan_helper::add_staging_buffers<
+    vulkan_helper::add_storage_memories<
+    vulkan_helper::add_storage_buffers<
+    vulkan_helper::memory_allocator<
+    add_storage_buffer_locations<
+    add_variable_pack_buffer_sizes<
+    vulkan_helper::timestamp_query_pool<
+    vulkan_helper::command_buffer<
+    add_compute_command_pool<
+    vulkan_helper::timeline_semaphore<
+    physical_device_cached_memory_properties<
+    variable_pack_pipelines<
+    app_pipeline_cache<
+    vulkan_helper::pipeline_layout<
+    vulkan_helper::descriptor_set<
+    vulkan_helper::descriptor_pool<
+    vulkan_helper::descriptor_set_layout<
+    kernel_reflection<
+    compute_queue, variable_pack_kernel
+    >>>>>>>>>>>>, ElementCount>, Location>>>>>>>;
+
+// packs ElementCount variable_pack::code, filled in through storage buffer 1;
+// codes of width 0 take no space, so fewer codes are packed by zeroing the
+// widths of the rest
+template<vulkan_helper::storage_location Location, uint32_t ElementCount>
+class variable_pack_engine : public variable_pack_engine_parent<Location, ElementCount> {
+public:
+    using parent = variable_pack_engine_parent<Location, ElementCount>;
+
+    variable_pack_engine()
+    {
+        write_storage_buffer_descriptors(*this, parent::get_descriptor_set(), parent::get_storage_buffers());
+        record_command_buffer();
+    }
+
+    void record_command_buffer() {
+        auto recorder = vulkan_helper::command_recorder{ parent::get_command_buffer() };
+        parent::begin();
+        parent::reset_timestamps();
+        auto upload_region = parent::begin_region("upload");
+        parent::record_staging_uploads();
+        parent::end_region(upload_region);
+        for (uint32_t pass = 0; pass < parent::pass_names.size(); pass++) {
+            auto region = parent::begin_region(parent::pass_names[pass]);
+            parent::record_variable_pack_pass(recorder, parent::get_descriptor_set(), pass, ElementCount);
+            parent::end_region(region);
+        }
+        auto readback_region = parent::begin_region("readback");
+        parent::record_staging_readbacks();
+        parent::end_region(readback_region);
+        parent::end();
+    }
+
+    // valid once the submission completed and host reads were invalidated
+    uint32_t get_packed_bit_count() {
+        return *static_cast<const uint32_t*>(parent::get_storage_memory_ptrs()[2]);
+    }
+};
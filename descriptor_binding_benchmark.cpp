@@ -0,0 +1,129 @@
+// Host cost of binding storage buffers per dispatch in each descriptor mode:
+// a command buffer of dispatch_count single group dispatches of test.comp is
+// recorded once binding slice 0 of both buffers up front, and once binding
+// slice i before dispatch i. The difference per dispatch is the bind cost of
+// the mode. A mode the device lacks falls back to the next one down, see
+// physical_device::choose_descriptor_mode. Every mode's rebinding command
+// buffer is run once and its slices are checked against the bit_repack CPU
+// reference, so a wrong binding shows up as a mismatch.
+//
+// usage: descriptor_binding_benchmark [iterations]
+#include <stdexcept>
+#include <iostream>
+#include <array>
+#include <chrono>
+#include <format>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vulkan/vulkan.h>
+#include "compute_app.hpp"
+#include "bit_repack.hpp"
+#include "latency_histogram.hpp"
+
+// one workgroup of test.comp per slice, 512 bytes of either buffer, which
+// meets every minStorageBufferOffsetAlignment
+constexpr uint32_t slice_elements = 256;
+constexpr uint32_t dispatch_count = vulkan_helper::descriptor_binder<compute_queue>::default_capacity;
+constexpr uint32_t element_count = slice_elements * dispatch_count;
+constexpr VkDeviceSize slice_size = slice_elements * sizeof(uint16_t);
+
+template<vulkan_helper::descriptor_mode Preferred>
+class descriptor_binding_benchmark : public descriptor_binding_app_parent<Preferred, repack_atomic_kernel, element_count> {
+public:
+    using parent = descriptor_binding_app_parent<Preferred, repack_atomic_kernel, element_count>;
+
+    descriptor_binding_benchmark() {
+        auto buffers = parent::get_storage_buffers();
+        for (uint32_t i = 0; i < dispatch_count; i++) {
+            m_slices.push_back({
+                VkDescriptorBufferInfo{ buffers[0], i * slice_size, slice_size },
+                VkDescriptorBufferInfo{ buffers[1], i * slice_size, slice_size } });
+        }
+    }
+    // returns the time spent recording
+    std::chrono::nanoseconds record(bool rebind) {
+        parent::reset_command_pool(parent::get_command_pool());
+        parent::reset_descriptor_bindings();
+        vulkan_helper::command_recorder recorder{ parent::get_command_buffer() };
+        auto start = std::chrono::steady_clock::now();
+        recorder.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE, parent::get_pipeline());
+        for (uint32_t i = 0; i < dispatch_count; i++) {
+            if (rebind || i == 0) {
+                parent::bind_storage_buffers(recorder, VK_PIPELINE_BIND_POINT_COMPUTE, parent::get_pipeline_layout(), m_slices[i]);
+            }
+            recorder.dispatch(1, 1, 1);
+        }
+        recorder.end();
+        return std::chrono::steady_clock::now() - start;
+    }
+    void submit_and_wait() {
+        parent::wait_for_value(parent::submit_timeline(parent::get_command_buffer()));
+    }
+    // runs the rebinding command buffer over random input, slice by slice
+    size_t count_mismatches() {
+        auto allocations = parent::get_storage_allocations();
+        auto out = static_cast<std::byte*>(allocations[0].mapped);
+        auto in = static_cast<uint16_t*>(allocations[1].mapped);
+        auto random = std::mt19937{ 1 };
+        std::fill(out, out + element_count * sizeof(uint16_t), std::byte{ 0 });
+        std::generate(in, in + element_count, [&random] { return static_cast<uint16_t>(random()); });
+        record(true);
+        submit_and_wait();
+
+        auto expected = std::vector<std::byte>(element_count * sizeof(uint16_t));
+        for (uint32_t i = 0; i < dispatch_count; i++) {
+            bit_repack::repack(std::span{ in + i * slice_elements, slice_elements },
+                std::span{ expected }.subspan(i * slice_size, slice_size));
+        }
+        return std::inner_product(expected.begin(), expected.end(), out, size_t{ 0 },
+            std::plus<>{}, [](std::byte lhs, std::byte rhs) { return size_t{ lhs != rhs }; });
+    }
+    void run(uint64_t iterations) {
+        auto mismatches = count_mismatches();
+        latency_histogram bound_once{};
+        latency_histogram rebound{};
+        for (uint64_t i = 0; i < iterations; i++) {
+            bound_once.record(record(false));
+            submit_and_wait();
+            rebound.record(record(true));
+            submit_and_wait();
+        }
+        auto ns = [](auto duration) {
+            return std::chrono::duration<double, std::nano>{ duration }.count() / dispatch_count;
+        };
+        std::cout << std::format("{:>18}: record {:.1f} ns/dispatch bound once, {:.1f} ns/dispatch rebound, bind {:.1f} ns, {}",
+            vulkan_helper::to_string(parent::get_descriptor_mode()),
+            ns(bound_once.percentile(0.5)), ns(rebound.percentile(0.5)),
+            ns(rebound.percentile(0.5)) - ns(bound_once.percentile(0.5)),
+            mismatches == 0 ? std::string{ "matches cpu reference" } : std::format("{} mismatching byte(s)", mismatches)) << std::endl;
+    }
+private:
+    std::vector<std::array<VkDescriptorBufferInfo, 2>> m_slices;
+};
+
+int main(int argc, char** argv) {
+    try {
+        uint64_t iterations = argc > 1 ? std::stoull(argv[1]) : 100;
+        std::cout << std::format("dispatches per command buffer: {}, median of {} recording(s)",
+            dispatch_count, iterations) << std::endl;
+        {
+            descriptor_binding_benchmark<vulkan_helper::descriptor_mode::descriptor_set> benchmark;
+            benchmark.run(iterations);
+        }
+        {
+            descriptor_binding_benchmark<vulkan_helper::descriptor_mode::push_descriptor> benchmark;
+            benchmark.run(iterations);
+        }
+        {
+            descriptor_binding_benchmark<vulkan_helper::descriptor_mode::descriptor_buffer> benchmark;
+            benchmark.run(iterations);
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Compares the result dump paths over one buffer of words: the per word
+// std::format loop main.cpp used to have, the scalar and avx2 hex formatters
+// into memory, the chunked stream dumper and the mapped output file. Streams
+// go to the null device so only formatting and write calls are measured.
+//
+// usage: dump_benchmark [words] [iterations] [output file]
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <functional>
+#include <numeric>
+#include <string>
+#include <vector>
+#include "result_dump.hpp"
+
+#ifdef _WIN32
+constexpr const char* null_device = "NUL";
+#else
+constexpr const char* null_device = "/dev/null";
+#endif
+
+template<class F>
+double measure(uint64_t iterations, F&& f) {
+    f();
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++) {
+        f();
+    }
+    return std::chrono::duration<double>{ std::chrono::steady_clock::now() - start }.count() / iterations;
+}
+
+int main(int argc, char** argv) {
+    try {
+        size_t count = argc > 1 ? std::stoull(argv[1]) : size_t{ 1 } << 22;
+        uint64_t iterations = argc > 2 ? std::stoull(argv[2]) : 5;
+        std::string path = argc > 3 ? argv[3] : "dump_benchmark.txt";
+
+        auto words = std::vector<uint32_t>(count);
+        std::iota(words.begin(), words.end(), 0u);
+        const auto text_size = result_dump::section_size(result_dump::format::hex, count);
+
+        std::string expected;
+        auto format_loop = [&] {
+            expected.clear();
+            expected += result_dump::separator;
+            for (size_t t = 0; t < words.size(); t++) {
+                expected += std::format("{:#010x}", words[t]);
+                expected += ", ";
+                if (t % 8 == 7) {
+                    expected += '\n';
+                }
+            }
+            expected += '\n';
+        };
+
+        auto null_file = std::fopen(null_device, "wb");
+        if (null_file == nullptr) {
+            throw std::runtime_error{ "failed to open the null device" };
+        }
+        std::cout << std::format("words: {}, hex text: {} bytes", count, text_size) << std::endl;
+        auto report = [&](std::string_view name, double seconds, bool match = true) {
+            std::cout << std::format("{:>14}: {:.2f} ms, {:.2f} GB/s of text{}", name, seconds * 1000,
+                text_size / seconds / 1e9, match ? "" : ", MISMATCH") << std::endl;
+        };
+        report("std::format", measure(iterations, format_loop));
+
+        auto text = std::string(text_size, '\0');
+        auto format_rows = [&](result_dump::format_hex_rows_function format_hex_rows) {
+            auto out = text.data();
+            std::memcpy(out, result_dump::separator.data(), result_dump::separator.size());
+            out = format_hex_rows(words.data(), count / result_dump::row_words, out + result_dump::separator.size());
+            for (size_t t = count / result_dump::row_words * result_dump::row_words; t < count; t++) {
+                out = result_dump::format_hex_word(words[t], out);
+            }
+            *out = '\n';
+        };
+        report("scalar", measure(iterations, [&] { format_rows(result_dump::format_hex_rows_scalar); }), text == expected);
+#ifdef BIT_REPACK_X86
+        if (bit_repack::is_supported(bit_repack::isa::avx2)) {
+            text.assign(text_size, '\0');
+            report("avx2", measure(iterations, [&] { format_rows(result_dump::format_hex_rows_avx2); }), text == expected);
+        }
+        else {
+            std::cout << std::format("{:>14}: not supported", "avx2") << std::endl;
+        }
+#endif
+        report("stream", measure(iterations, [&] {
+            result_dump::stream_dumper dumper{ null_file };
+            dumper.dump(result_dump::format::hex, words);
+        }));
+        std::array<std::span<const uint32_t>, 1> sections{ words };
+        report("mapped file", measure(iterations, [&] {
+            result_dump::dump_to_file(path, result_dump::format::hex, sections);
+        }));
+        std::fclose(null_file);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+// Log-linear histogram in the spirit of HdrHistogram: every power of two is
+// split into 2^(sub_bucket_bits-1) linear sub-buckets, so recording is a couple
+// of bit operations and an increment, and any reported value is within
+// 1/2^(sub_bucket_bits-1) of the recorded one.
+class latency_histogram {
+public:
+    static constexpr uint32_t sub_bucket_bits = 5;
+    static constexpr uint32_t sub_bucket_count = 1u << sub_bucket_bits;
+    static constexpr uint32_t bucket_count = 64 - sub_bucket_bits + 1;
+
+    void record(std::chrono::nanoseconds latency) {
+        auto value = static_cast<uint64_t>(latency.count() < 0 ? 0 : latency.count());
+        m_counts[index_of(value)]++;
+        m_total_count++;
+        m_sum += value;
+        m_min = value < m_min ? value : m_min;
+        m_max = value > m_max ? value : m_max;
+    }
+    void reset() {
+        *this = latency_histogram{};
+    }
+
+    uint64_t count() const {
+        return m_total_count;
+    }
+    std::chrono::nanoseconds min() const {
+        return std::chrono::nanoseconds{ m_total_count ? m_min : 0 };
+    }
+    std::chrono::nanoseconds max() const {
+        return std::chrono::nanoseconds{ m_max };
+    }
+    std::chrono::duration<double, std::nano> mean() const {
+        return std::chrono::duration<double, std::nano>{ m_total_count ? static_cast<double>(m_sum) / m_total_count : 0.0 };
+    }
+    // value at or below which the given fraction of recorded samples fall, quantile in [0, 1]
+    std::chrono::nanoseconds percentile(double quantile) const {
+        if (m_total_count == 0) {
+            return std::chrono::nanoseconds{ 0 };
+        }
+        auto rank = static_cast<uint64_t>(quantile * m_total_count + 0.5);
+        rank = rank < 1 ? 1 : (rank > m_total_count ? m_total_count : rank);
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < m_counts.size(); i++) {
+            seen += m_counts[i];
+            if (seen >= rank) {
+                auto value = highest_equivalent_value(i);
+                return std::chrono::nanoseconds{ value < m_max ? value : m_max };
+            }
+        }
+        return max();
+    }
+
+private:
+    static uint32_t index_of(uint64_t value) {
+        // values below sub_bucket_count land in bucket 0 with unit resolution
+        uint32_t bucket = value < sub_bucket_count ? 0 : std::bit_width(value) - sub_bucket_bits;
+        uint32_t sub_bucket = static_cast<uint32_t>(value >> bucket) & (sub_bucket_count - 1);
+        if (bucket != 0) {
+            sub_bucket |= sub_bucket_count >> 1;
+        }
+        return bucket * (sub_bucket_count >> 1) + sub_bucket;
+    }
+    static uint64_t highest_equivalent_value(uint32_t index) {
+        constexpr uint32_t half = sub_bucket_count >> 1;
+        if (index < sub_bucket_count) {
+            return index;
+        }
+        uint32_t bucket = index / half - 1;
+        uint64_t sub_bucket = index % half + half;
+        return ((sub_bucket + 1) << bucket) - 1;
+    }
+
+    std::array<uint64_t, bucket_count * (sub_bucket_count >> 1) + (sub_bucket_count >> 1)> m_counts{};
+    uint64_t m_total_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_min = std::numeric_limits<uint64_t>::max();
+    uint64_t m_max = 0;
+};
@@ -32,6 +32,9 @@ struct App {
 
 typedef struct App App;
 
+/* test.comp reads and writes 128 uints per buffer */
+#define STORAGE_BUFFER_SIZE (128 * sizeof(uint32_t))
+
 void create_instance(App* app) {
   VkApplicationInfo application_info =
   {
@@ -184,11 +187,19 @@ void destroy_descriptor_set_layout(App* app) {
 }
 
 void create_pipeline_layout(App* app) {
+  /* test.comp declares three uints of push constants */
+  VkPushConstantRange push_constant_range = {
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .offset = 0,
+    .size = 3 * sizeof(uint32_t),
+  };
   VkPipelineLayoutCreateInfo create_info = {
     .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
     .flags = 0,
     .setLayoutCount = 1,
     .pSetLayouts = &app->descriptor_set_layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &push_constant_range,
   };
 
   VkResult res = vkCreatePipelineLayout(app->device, &create_info, NULL,
@@ -342,12 +353,13 @@ void unmap_device_memory(App* app, VkDeviceMemory device_memory) {
 
 void create_storage_buffer(App* app) {
   app->storage_buffer = create_buffer(app,
-				      128, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+				      STORAGE_BUFFER_SIZE,
+				      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
   app->storage_memory = alloc_device_memory(app, app->storage_buffer,
 					    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
 					    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
   app->storage_memory_ptr = map_device_memory(app, app->storage_memory,
-					      0, 128);
+					      0, STORAGE_BUFFER_SIZE);
 }
 
 void destroy_storage_buffer(App* app) {
@@ -394,7 +406,7 @@ void update_descriptor_set(App* app) {
   VkDescriptorBufferInfo buffer_info = {
     .buffer = app->storage_buffer,
     .offset = 0,
-    .range = 128,
+    .range = STORAGE_BUFFER_SIZE,
   };
 
   VkWriteDescriptorSet write = {
@@ -463,7 +475,7 @@ void draw(App* app) {
     .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
     .memory = app->storage_memory,
     .offset = 0,
-    .size = 128,
+    .size = VK_WHOLE_SIZE,
   };
   res = vkInvalidateMappedMemoryRanges(app->device, 1,
 						&memory_range);
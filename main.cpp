@@ -4,167 +4,22 @@
 #include <cassert>
 #include <fstream>
 #include <array>
+#include <chrono>
+#include <format>
+#include <optional>
+#include <filesystem>
 #include <vulkan/vulkan.h>
-#include "vulkan_helper.hpp"
-#include "spirv_helper.hpp"
+#include "compute_app.hpp"
+#include "bit_repack.hpp"
+#include "result_dump.hpp"
+#include "pattern_fill.hpp"
+#include "mmaped_file.hpp"
+#include "result_verify.hpp"
 
-class first_physical_device : public vulkan_helper::physical_device {
-public:
-    first_physical_device() : physical_device{
-        [](vulkan_helper::instance& instance) {
-            return instance.get_first_physical_device();
-        }
-    }
-    {}
-};
-
-class compute_queue_physical_device : public first_physical_device {
-public:
-    compute_queue_physical_device() : m_compute_queue_family_index {
-        physical_device::find_queue_family_if(
-            [](VkQueueFamilyProperties properties) {
-                return VK_QUEUE_COMPUTE_BIT & properties.queueFlags;
-            }
-        )
-    }
-    {}
-    uint32_t get_compute_queue_family_index() {
-        return m_compute_queue_family_index;
-    }
-private:
-    uint32_t m_compute_queue_family_index;
-};
-
-class compute_queue_device : public vulkan_helper::device<compute_queue_physical_device> {
-public:
-    compute_queue_device() :
-        device{ [](compute_queue_physical_device& physical_device) {
-        vulkan_helper::device_create_info info{};
-        info.set_queue_family_index(physical_device.get_compute_queue_family_index());
-        return info;
-            }
-    }
-    {}
-};
-
-class compute_queue : public compute_queue_device {
-public:
-    compute_queue() :
-        m_queue{
-        device::get_device_queue(compute_queue_device::get_compute_queue_family_index(), 0)
-    }
-    {}
-    VkQueue get_queue() {
-        return m_queue;
-    }
-private:
-    VkQueue m_queue;
-};
+using app_parent = ring_compute_app<vulkan_helper::storage_location::host_cached, 3>;
 
-template<class D>
-class add_compute_command_pool : public vulkan_helper::command_pool<D> {
+class App : public app_parent {
 public:
-    add_compute_command_pool() :
-        vulkan_helper::command_pool<D>{
-        [](D& device) {
-            return device.create_command_pool(device.get_compute_queue_family_index());
-        }
-    }
-    {}
-};
-
-template<class PD>
-class physical_device_cached_memory_properties : public PD {
-public:
-    physical_device_cached_memory_properties() : 
-        m_memory_properties{
-        PD::get_memory_properties()
-    }
-    {}
-    const auto& get_memory_properties() const {
-        return m_memory_properties;
-    }
-private:
-    VkPhysicalDeviceMemoryProperties m_memory_properties;
-};
-
-template<class D>
-class app_pipeline : public vulkan_helper::pipeline<D> {
-public:
-    app_pipeline() : vulkan_helper::pipeline<D>{ 
-        [](D& device) { 
-            return vulkan_helper::shader_module<D>{device, spirv_file{ "comp.spv" }};
-        }
-    }
-    {}
-};
-
-template<class D>
-class add_storage_buffer_sizes : public D {
-public:
-    auto get_storage_buffer_sizes() const {
-        return std::vector{ 128*sizeof(uint32_t), 128*sizeof(uint32_t)};
-    }
-};
-
-using app_parent =
-    vulkan_helper::add_storage_memory_ptrs<
-    vulkan_helper::add_storage_memories<
-    vulkan_helper::add_storage_buffers<
-    add_storage_buffer_sizes<
-    vulkan_helper::command_buffer<
-    add_compute_command_pool<
-    vulkan_helper::fence<
-    physical_device_cached_memory_properties<
-    app_pipeline<
-    vulkan_helper::pipeline_layout<
-    vulkan_helper::descriptor_set<
-    vulkan_helper::descriptor_pool<
-    vulkan_helper::descriptor_set_layout<
-    compute_queue
-    >>>>>>>>>>>>>;
-
-
-class App : public app_parent{
-public:
-    App()
-    {
-        auto storage_buffers = app_parent::get_storage_buffers();
-        auto buffer_infos = std::vector<VkDescriptorBufferInfo>(storage_buffers.size());
-        std::transform(
-            storage_buffers.begin(),
-            storage_buffers.end(),
-            buffer_infos.begin(),
-            [](auto& buffer) {
-                VkDescriptorBufferInfo buffer_info{};
-                buffer_info.buffer = buffer;
-                buffer_info.offset = 0;
-                buffer_info.range = 128*sizeof(uint32_t);
-                return buffer_info;
-            }
-        );
-
-        VkWriteDescriptorSet write{};
-        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write.dstSet = app_parent::get_descriptor_set();
-        write.dstArrayElement = 0;
-        write.descriptorCount = buffer_infos.size();
-        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        write.pBufferInfo = buffer_infos.data();
-        app_parent::update_descriptor_set(write);
-        
-        record_command_buffer();
-    }
-
-    void record_command_buffer() {
-        command_buffer::begin();
-        command_buffer::bind_pipeline(VK_PIPELINE_BIND_POINT_COMPUTE, app_parent::get_pipeline());
-        command_buffer::bind_descriptor_set(VK_PIPELINE_BIND_POINT_COMPUTE, 
-                app_parent::get_pipeline_layout(), app_parent::get_descriptor_set());
-        command_buffer::dispatch(1, 1, 1);
-        command_buffer::end();
-    }
-
     uint32_t findProperties(uint32_t memoryTypeBitsRequirements, VkMemoryPropertyFlags requiredProperty) {
         const uint32_t memoryCount = app_parent::get_memory_properties().memoryTypeCount;
         for (uint32_t memoryIndex = 0; memoryIndex < memoryCount; memoryIndex++) {
@@ -179,79 +34,236 @@ public:
         }
         throw std::runtime_error{"failed find memory property"};
     }
-    void draw() {
-        fence::reset();
-
-        if (true) {
-            auto sizes = app_parent::get_storage_buffer_sizes();
-            auto ptrs = app_parent::get_storage_memory_ptrs();
-            auto indices = std::vector<uint32_t>(sizes.size());
-            std::iota(indices.begin(), indices.end(), 0);
-            for (auto i : indices) {
-                auto size = sizes[i];
-                auto ptr = ptrs[i];
-
-                uint32_t* data = reinterpret_cast<uint32_t*>(ptr);
-                for (uint32_t t = 0; t < size/sizeof(uint32_t); t++) {
-                    data[t] = t;
-                }
+    // fills the frame's host written inputs while the previous frames are still executing
+    void draw(vulkan_helper::ring_frame& frame) {
+        auto sizes = app_parent::get_storage_buffer_sizes();
+        for (size_t i = 0; i < sizes.size(); i++) {
+            if (!app_parent::is_host_input(i)) {
+                continue;
             }
+            auto data = reinterpret_cast<uint32_t*>(frame.host_allocation(i).mapped);
+            pattern_fill::fill(m_fill_pool, m_pattern, std::span{ data, sizes[i] / sizeof(uint32_t) });
         }
-
-        VkCommandBufferSubmitInfo command_buffer_submit_info{};
-        {
-            auto& info = command_buffer_submit_info;
-            info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
-            info.commandBuffer = app_parent::get_command_buffer();
+        app_parent::submit_frame(frame);
+    }
+    // every retired frame is verified, so long runs double as soak tests
+    void retire(vulkan_helper::ring_frame& frame) {
+        m_gpu_time += app_parent::get_frame_duration(frame);
+        m_retired_count++;
+        m_last_retired = &frame;
+        verify(frame);
+    }
+    // dumps every storage buffer to stdout, or to the output file if one is set
+    void print(const vulkan_helper::ring_frame& frame) {
+        auto sizes = app_parent::get_storage_buffer_sizes();
+        auto sections = std::vector<std::span<const uint32_t>>{};
+        for (size_t i = 0; i < sizes.size(); i++) {
+            auto data = reinterpret_cast<const uint32_t*>(frame.host_allocation(i).mapped);
+            sections.emplace_back(data, sizes[i] / sizeof(uint32_t));
         }
-        VkSubmitInfo2 submit_info{};
-        {
-            auto& info = submit_info;
-            info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
-            info.commandBufferInfoCount = 1;
-            info.pCommandBufferInfos = &command_buffer_submit_info;
-            auto res = vkQueueSubmit2(compute_queue::get_queue(), 1, &submit_info, fence::get_fence());
-	    if (res != VK_SUCCESS) {
-	      throw std::runtime_error{"failed to submit queue"};
-	    }
+        if (m_dump_path) {
+            result_dump::dump_to_file(*m_dump_path, m_dump_format, sections);
+            return;
         }
-
-        fence::wait_for();
-
-        if (true) {
-            auto sizes = app_parent::get_storage_buffer_sizes();
-            auto ptrs = app_parent::get_storage_memory_ptrs();
-            auto indices = std::vector<uint32_t>(sizes.size());
-            std::iota(indices.begin(), indices.end(), 0);
-            for (auto i : indices) {
-                auto size = sizes[i];
-                auto ptr = ptrs[i];
-
-                std::cout << "-----------------------------------------------" << std::endl;
-                uint32_t* data = reinterpret_cast<uint32_t*>(ptr);
-                for (uint32_t t = 0; t < size / sizeof(uint32_t); t++) {
-                    std::cout << std::format("{:#010x}", data[t]) << ", ";
-                    if (t % 8 == 7) {
-                        std::cout << std::endl;
-                    }
-                }
-                std::cout << std::endl;
+        std::cout.flush();
+        result_dump::stream_dumper dumper{ stdout };
+        for (auto& words : sections) {
+            dumper.dump(m_dump_format, words);
+        }
+    }
+    // with on_device the frame command buffers write the pattern and draw()
+    // leaves the storage alone
+    void set_pattern(pattern_fill::pattern pattern, bool on_device) {
+        pattern_fill::check_pattern(pattern);
+        m_pattern = pattern;
+        if (m_golden_file.empty()) {
+            m_golden = {};
+        }
+        if (on_device) {
+            app_parent::set_device_patterns(std::vector<std::optional<pattern_fill::pattern>>(
+                app_parent::get_storage_buffer_sizes().size(), pattern));
+        }
+    }
+    void set_dump_output(result_dump::format format, std::optional<std::filesystem::path> path) {
+        m_dump_format = format;
+        m_dump_path = std::move(path);
+    }
+    // compares against this file instead of the cpu reference, see
+    // result_verify::golden_words
+    void set_golden_file(const std::filesystem::path& path) {
+        m_golden_file = mmaped_file{ path };
+        m_golden = result_verify::golden_words(m_golden_file, get_output_word_count());
+    }
+    void verify(const vulkan_helper::ring_frame& frame) {
+        if (m_golden.empty()) {
+            m_golden_storage = compute_golden();
+            m_golden = m_golden_storage;
+        }
+        auto out = reinterpret_cast<const uint32_t*>(frame.host_allocation(0).mapped);
+        auto report = result_verify::compare(m_fill_pool, m_golden, std::span{ out, get_output_word_count() });
+        m_verified_count++;
+        if (!report.passed()) {
+            if (m_failed_count == 0) {
+                m_first_failure = std::move(report);
+                m_first_failed_frame = m_retired_count;
+            }
+            m_failed_count++;
+        }
+    }
+    // false if any frame mismatched
+    bool report_verification() {
+        auto golden = m_golden_file.empty() ?
+            std::format("cpu reference ({})", bit_repack::to_string(bit_repack::best_supported_isa())) :
+            std::string{ "golden file" };
+        std::cout << std::format("{}: {} of {} frame(s) mismatching", golden, m_failed_count, m_verified_count) << std::endl;
+        if (m_failed_count > 0) {
+            std::cout << std::format("first mismatching frame {}: {}", m_first_failed_frame,
+                result_verify::to_string(m_first_failure)) << std::endl;
+        }
+        return m_failed_count == 0;
+    }
+    // false if any retired frame mismatched
+    bool run(uint32_t iterations) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            auto& frame = app_parent::acquire_frame();
+            if (frame.has_results) {
+                retire(frame);
+            }
+            draw(frame);
+        }
+        for (auto in_flight = app_parent::get_in_flight_count(); in_flight > 0;) {
+            auto& frame = app_parent::acquire_frame();
+            if (frame.has_results) {
+                retire(frame);
+                in_flight--;
             }
         }
-        
+        auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - start };
+
+        if (m_retired_count > 0) {
+            std::cout << std::format("gpu dispatch: {:.3f} us mean over {} frame(s), {:.1f} frames/s with {} in flight",
+                m_gpu_time.count() / 1000.0 / m_retired_count, m_retired_count,
+                m_retired_count / elapsed.count(), app_parent::frame_count) << std::endl;
+        }
+        if (m_last_retired == nullptr) {
+            return true;
+        }
+        print(*m_last_retired);
+        return report_verification();
     }
-    void run() {
-      for (int i = 0; i < 1; i++)
-          draw();
+    void report_startup(std::chrono::nanoseconds startup_time) {
+        using milliseconds = std::chrono::duration<double, std::milli>;
+        std::cout << std::format("startup: {} ({} pipeline cache), {} pipeline(s) created in {}",
+            milliseconds{ startup_time },
+            app_parent::is_pipeline_cache_warm() ? "warm" : "cold",
+            app_parent::get_pipeline_creation_count(),
+            milliseconds{ app_parent::get_pipeline_creation_time() }) << std::endl;
+        auto memory = app_parent::get_memory_allocator_statistics();
+        std::cout << std::format("device memory: {} allocation(s), {} bytes in {} block(s) of {} bytes",
+            memory.allocation_count, memory.allocated_bytes, memory.block_count, memory.block_bytes) << std::endl;
     }
+private:
+    size_t get_output_word_count() {
+        return app_parent::get_storage_buffer_sizes()[0] / sizeof(uint32_t);
+    }
+    // the kernel on the host over the pattern's input; the output words the
+    // kernel does not reach keep the pattern too
+    std::vector<uint32_t> compute_golden() {
+        auto sizes = app_parent::get_storage_buffer_sizes();
+        auto in = std::vector<uint32_t>(sizes[1] / sizeof(uint32_t));
+        pattern_fill::fill(m_pattern, in);
+        auto expected = std::vector<uint32_t>(sizes[0] / sizeof(uint32_t));
+        pattern_fill::fill(m_pattern, expected);
+        auto in_elements = std::span{ reinterpret_cast<const uint16_t*>(in.data()), in.size() * 2 };
+        bit_repack::repack(in_elements, std::as_writable_bytes(std::span{ expected }));
+        return expected;
+    }
+
+    std::chrono::duration<double, std::nano> m_gpu_time{};
+    uint64_t m_retired_count = 0;
+    const vulkan_helper::ring_frame* m_last_retired = nullptr;
+    result_dump::format m_dump_format = result_dump::format::hex;
+    std::optional<std::filesystem::path> m_dump_path;
+    pattern_fill::pattern m_pattern;
+    thread_pool m_fill_pool;
+    mmaped_file m_golden_file;
+    std::vector<uint32_t> m_golden_storage;
+    std::span<const uint32_t> m_golden;
+    uint64_t m_verified_count = 0;
+    uint64_t m_failed_count = 0;
+    uint64_t m_first_failed_frame = 0;
+    result_verify::report m_first_failure;
 };
 
-int main() {
+// iota[:start], random[:seed], constant[:word] or file:<path>; the mapped
+// pattern file is kept open in file
+pattern_fill::pattern parse_pattern(std::string_view spec, mmaped_file& file) {
+    auto colon = spec.find(':');
+    auto name = spec.substr(0, colon);
+    auto argument = colon == std::string_view::npos ? std::string{} : std::string{ spec.substr(colon + 1) };
+    auto pattern = pattern_fill::pattern{};
+    if (name == "file") {
+        file = mmaped_file{ argument };
+        pattern.kind = pattern_fill::pattern_kind::file;
+        pattern.words = { reinterpret_cast<const uint32_t*>(file.data()), file.size() / sizeof(uint32_t) };
+        return pattern;
+    }
+    if (name == "random") {
+        pattern.kind = pattern_fill::pattern_kind::random;
+        pattern.seed = argument.empty() ? 0 : std::stoull(argument, nullptr, 0);
+        return pattern;
+    }
+    if (name == "constant") {
+        pattern.kind = pattern_fill::pattern_kind::constant;
+    }
+    else if (name != "iota") {
+        throw std::runtime_error{ "unknown pattern " + std::string{ spec } };
+    }
+    pattern.value = argument.empty() ? 0 : static_cast<uint32_t>(std::stoul(argument, nullptr, 0));
+    return pattern;
+}
+
+// usage: compute_shader_debug [iterations] [hex|binary] [output file|-] [pattern] [host|device] [golden file]
+int main(int argc, char** argv) {
     try{
+        uint32_t iterations = argc > 1 ? std::stoul(argv[1]) : 1;
+        auto dump_format = result_dump::format::hex;
+        if (argc > 2) {
+            auto name = std::string_view{ argv[2] };
+            if (name == "binary") {
+                dump_format = result_dump::format::binary;
+            }
+            else if (name != "hex") {
+                throw std::runtime_error{ "unknown dump format " + std::string{ name } };
+            }
+        }
+        auto dump_path = argc > 3 && std::string_view{ argv[3] } != "-" ?
+            std::optional<std::filesystem::path>{ argv[3] } : std::nullopt;
+        mmaped_file pattern_file;
+        auto pattern = argc > 4 ? parse_pattern(argv[4], pattern_file) : pattern_fill::pattern{};
+        bool on_device = false;
+        if (argc > 5) {
+            auto where = std::string_view{ argv[5] };
+            on_device = where == "device";
+            if (!on_device && where != "host") {
+                throw std::runtime_error{ "unknown pattern location " + std::string{ where } };
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
         App app;
-        app.run();
+        app.set_dump_output(dump_format, std::move(dump_path));
+        app.set_pattern(pattern, on_device);
+        if (argc > 6) {
+            app.set_golden_file(argv[6]);
+        }
+        app.report_startup(std::chrono::steady_clock::now() - start);
+        if (!app.run(iterations)) {
+            return 1;
+        }
     } catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
+        return 1;
     }
     return 0;
 }
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <optional>
+
+namespace vulkan_helper {
+    // First-fit free list over one contiguous range, used to sub-allocate a
+    // VkDeviceMemory block. Free ranges are kept sorted by offset so
+    // neighbours coalesce on free.
+    class free_list_suballocator {
+    public:
+        explicit free_list_suballocator(uint64_t size) : m_size{ size } {
+            if (size > 0) {
+                m_free_ranges.emplace(0, size);
+            }
+        }
+
+        // returns the aligned offset, alignment must be a power of two
+        std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment) {
+            for (auto ite = m_free_ranges.begin(); ite != m_free_ranges.end(); ++ite) {
+                auto [range_offset, range_size] = *ite;
+                auto offset = (range_offset + alignment - 1) & ~(alignment - 1);
+                auto padding = offset - range_offset;
+                if (padding > range_size || range_size - padding < size) {
+                    continue;
+                }
+                m_free_ranges.erase(ite);
+                if (padding > 0) {
+                    m_free_ranges.emplace(range_offset, padding);
+                }
+                auto tail = range_size - padding - size;
+                if (tail > 0) {
+                    m_free_ranges.emplace(offset + size, tail);
+                }
+                m_used += size;
+                return offset;
+            }
+            return std::nullopt;
+        }
+        void free(uint64_t offset, uint64_t size) {
+            m_used -= size;
+            auto next = m_free_ranges.lower_bound(offset);
+            if (next != m_free_ranges.begin()) {
+                auto prev = std::prev(next);
+                if (prev->first + prev->second == offset) {
+                    offset = prev->first;
+                    size += prev->second;
+                    m_free_ranges.erase(prev);
+                }
+            }
+            if (next != m_free_ranges.end() && offset + size == next->first) {
+                size += next->second;
+                m_free_ranges.erase(next);
+            }
+            m_free_ranges.emplace(offset, size);
+        }
+
+        uint64_t size() const {
+            return m_size;
+        }
+        uint64_t used() const {
+            return m_used;
+        }
+        bool empty() const {
+            return m_used == 0;
+        }
+        uint64_t largest_free_range() const {
+            uint64_t largest = 0;
+            for (auto& [offset, size] : m_free_ranges) {
+                largest = size > largest ? size : largest;
+            }
+            return largest;
+        }
+    private:
+        uint64_t m_size;
+        uint64_t m_used = 0;
+        std::map<uint64_t, uint64_t> m_free_ranges;
+    };
+}
@@ -1,38 +1,336 @@
 #pragma once
-#include <windows.h>
+#include <algorithm>
+#include <cerrno>
 #include <filesystem>
-#include <cassert>
+#include <stdexcept>
 #include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct mmap_options {
+    // tell the kernel the mapping is read front to back, so readahead is aggressive
+    bool sequential = true;
+    // fault every page in at map time instead of on first touch
+    bool populate = false;
+};
 
 class mmaped_file {
 public:
-    mmaped_file(std::filesystem::path path) {
-        hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-        assert(hFile != INVALID_HANDLE_VALUE);
-        hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-        assert(hFile != INVALID_HANDLE_VALUE);
-        mmaped_ptr = static_cast<byte*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
-        assert(mmaped_ptr != nullptr);
+    mmaped_file() = default;
+    mmaped_file(std::filesystem::path path, mmap_options options = {}) {
+        open(path, options);
     }
     mmaped_file(const mmaped_file& file) = delete;
-    mmaped_file(mmaped_file&& file) = delete;
+    mmaped_file(mmaped_file&& file) noexcept {
+        swap(file);
+    }
     ~mmaped_file() {
-        UnmapViewOfFile(mmaped_ptr);
-        CloseHandle(hMapping);
-        CloseHandle(hFile);
+        close();
     }
     mmaped_file& operator=(const mmaped_file& file) = delete;
-    mmaped_file& operator=(mmaped_file&& file) = delete;
+    mmaped_file& operator=(mmaped_file&& file) noexcept {
+        if (this != &file) {
+            close();
+            swap(file);
+        }
+        return *this;
+    }
 
-    byte* data() const {
+    std::byte* data() const {
         return mmaped_ptr;
     }
-    size_t size() const {
-        return GetFileSize(hFile, NULL);
+    uint64_t size() const {
+        return m_size;
+    }
+    bool empty() const {
+        return m_size == 0;
+    }
+    std::span<const std::byte> bytes() const {
+        return { mmaped_ptr, static_cast<size_t>(m_size) };
+    }
+
+    void swap(mmaped_file& file) noexcept {
+        std::swap(hFile, file.hFile);
+#ifdef _WIN32
+        std::swap(hMapping, file.hMapping);
+#endif
+        std::swap(mmaped_ptr, file.mmaped_ptr);
+        std::swap(m_size, file.m_size);
     }
 
 private:
-    HANDLE hFile;
-    HANDLE hMapping;
-    byte* mmaped_ptr;
-};
\ No newline at end of file
+#ifdef _WIN32
+    void open(const std::filesystem::path& path, mmap_options options) {
+        DWORD flags = FILE_ATTRIBUTE_NORMAL;
+        if (options.sequential) {
+            flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+        }
+        hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error{ "failed to open file " + path.string() };
+        }
+        LARGE_INTEGER file_size{};
+        if (!GetFileSizeEx(hFile, &file_size)) {
+            close();
+            throw std::runtime_error{ "failed to get file size " + path.string() };
+        }
+        m_size = static_cast<uint64_t>(file_size.QuadPart);
+        if (m_size == 0) {
+            return;
+        }
+        hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping == NULL) {
+            close();
+            throw std::runtime_error{ "failed to create file mapping " + path.string() };
+        }
+        mmaped_ptr = static_cast<std::byte*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+        if (mmaped_ptr == nullptr) {
+            close();
+            throw std::runtime_error{ "failed to map file " + path.string() };
+        }
+#if defined(_WIN32_WINNT_WIN8) && _WIN32_WINNT >= _WIN32_WINNT_WIN8
+        if (options.populate) {
+            WIN32_MEMORY_RANGE_ENTRY range{ mmaped_ptr, static_cast<SIZE_T>(m_size) };
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+        }
+#endif
+    }
+    void close() noexcept {
+        if (mmaped_ptr != nullptr) {
+            UnmapViewOfFile(mmaped_ptr);
+        }
+        if (hMapping != NULL) {
+            CloseHandle(hMapping);
+        }
+        if (hFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hFile);
+        }
+        hFile = INVALID_HANDLE_VALUE;
+        hMapping = NULL;
+        mmaped_ptr = nullptr;
+        m_size = 0;
+    }
+
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+#else
+    void open(const std::filesystem::path& path, mmap_options options) {
+        hFile = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (hFile < 0) {
+            throw std::runtime_error{ "failed to open file " + path.string() };
+        }
+        struct stat file_stat {};
+        if (fstat(hFile, &file_stat) != 0) {
+            close();
+            throw std::runtime_error{ "failed to get file size " + path.string() };
+        }
+        m_size = static_cast<uint64_t>(file_stat.st_size);
+        if (m_size == 0) {
+            return;
+        }
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        if (options.populate) {
+            flags |= MAP_POPULATE;
+        }
+#endif
+        void* ptr = mmap(nullptr, static_cast<size_t>(m_size), PROT_READ, flags, hFile, 0);
+        if (ptr == MAP_FAILED) {
+            close();
+            throw std::runtime_error{ "failed to map file " + path.string() };
+        }
+        mmaped_ptr = static_cast<std::byte*>(ptr);
+        if (options.sequential) {
+            posix_madvise(ptr, static_cast<size_t>(m_size), POSIX_MADV_SEQUENTIAL);
+        }
+    }
+    void close() noexcept {
+        if (mmaped_ptr != nullptr) {
+            munmap(mmaped_ptr, static_cast<size_t>(m_size));
+        }
+        if (hFile >= 0) {
+            ::close(hFile);
+        }
+        hFile = -1;
+        mmaped_ptr = nullptr;
+        m_size = 0;
+    }
+
+    int hFile = -1;
+#endif
+    std::byte* mmaped_ptr = nullptr;
+    uint64_t m_size = 0;
+};
+
+// Read write mapping of a file created, or truncated, to exactly size bytes,
+// for writing large outputs in place; the kernel writes the pages back.
+class mmaped_output_file {
+public:
+    mmaped_output_file() = default;
+    mmaped_output_file(std::filesystem::path path, uint64_t size) {
+        open(path, size);
+    }
+    mmaped_output_file(const mmaped_output_file& file) = delete;
+    mmaped_output_file(mmaped_output_file&& file) noexcept {
+        swap(file);
+    }
+    ~mmaped_output_file() {
+        close();
+    }
+    mmaped_output_file& operator=(const mmaped_output_file& file) = delete;
+    mmaped_output_file& operator=(mmaped_output_file&& file) noexcept {
+        if (this != &file) {
+            close();
+            swap(file);
+        }
+        return *this;
+    }
+
+    std::byte* data() const {
+        return mmaped_ptr;
+    }
+    uint64_t size() const {
+        return m_size;
+    }
+    std::span<std::byte> bytes() const {
+        return { mmaped_ptr, static_cast<size_t>(m_size) };
+    }
+
+    void swap(mmaped_output_file& file) noexcept {
+        std::swap(hFile, file.hFile);
+#ifdef _WIN32
+        std::swap(hMapping, file.hMapping);
+#endif
+        std::swap(mmaped_ptr, file.mmaped_ptr);
+        std::swap(m_size, file.m_size);
+    }
+
+private:
+#ifdef _WIN32
+    void open(const std::filesystem::path& path, uint64_t size) {
+        hFile = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error{ "failed to create file " + path.string() };
+        }
+        m_size = size;
+        if (m_size == 0) {
+            return;
+        }
+        hMapping = CreateFileMapping(hFile, NULL, PAGE_READWRITE,
+            static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), NULL);
+        if (hMapping == NULL) {
+            close();
+            throw std::runtime_error{ "failed to create file mapping " + path.string() };
+        }
+        mmaped_ptr = static_cast<std::byte*>(MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, 0));
+        if (mmaped_ptr == nullptr) {
+            close();
+            throw std::runtime_error{ "failed to map file " + path.string() };
+        }
+    }
+    void close() noexcept {
+        if (mmaped_ptr != nullptr) {
+            UnmapViewOfFile(mmaped_ptr);
+        }
+        if (hMapping != NULL) {
+            CloseHandle(hMapping);
+        }
+        if (hFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hFile);
+        }
+        hFile = INVALID_HANDLE_VALUE;
+        hMapping = NULL;
+        mmaped_ptr = nullptr;
+        m_size = 0;
+    }
+
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+#else
+    void open(const std::filesystem::path& path, uint64_t size) {
+        hFile = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (hFile < 0) {
+            throw std::runtime_error{ "failed to create file " + path.string() };
+        }
+        m_size = size;
+        if (m_size == 0) {
+            return;
+        }
+        if (ftruncate(hFile, static_cast<off_t>(size)) != 0) {
+            close();
+            throw std::runtime_error{ "failed to resize file " + path.string() };
+        }
+        void* ptr = mmap(nullptr, static_cast<size_t>(m_size), PROT_READ | PROT_WRITE, MAP_SHARED, hFile, 0);
+        if (ptr == MAP_FAILED) {
+            close();
+            throw std::runtime_error{ "failed to map file " + path.string() };
+        }
+        mmaped_ptr = static_cast<std::byte*>(ptr);
+        posix_madvise(ptr, static_cast<size_t>(m_size), POSIX_MADV_SEQUENTIAL);
+    }
+    void close() noexcept {
+        if (mmaped_ptr != nullptr) {
+            munmap(mmaped_ptr, static_cast<size_t>(m_size));
+        }
+        if (hFile >= 0) {
+            ::close(hFile);
+        }
+        hFile = -1;
+        mmaped_ptr = nullptr;
+        m_size = 0;
+    }
+
+    int hFile = -1;
+#endif
+    std::byte* mmaped_ptr = nullptr;
+    uint64_t m_size = 0;
+};
+
+// writes bytes to path and waits until they are on the disk, so a rename
+// that follows never exposes a file shorter than what was written
+inline void write_file_synced(const std::filesystem::path& path, std::span<const std::byte> bytes) {
+#ifdef _WIN32
+    auto file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error{ "failed to create file " + path.string() };
+    }
+    bool written = true;
+    for (size_t offset = 0; written && offset < bytes.size();) {
+        DWORD count = 0;
+        auto chunk = static_cast<DWORD>(std::min<size_t>(bytes.size() - offset, DWORD{ 1 } << 30));
+        written = WriteFile(file, bytes.data() + offset, chunk, &count, NULL) && count > 0;
+        offset += count;
+    }
+    written = written && FlushFileBuffers(file);
+    CloseHandle(file);
+#else
+    int file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file == -1) {
+        throw std::runtime_error{ "failed to create file " + path.string() };
+    }
+    bool written = true;
+    for (size_t offset = 0; written && offset < bytes.size();) {
+        auto count = ::write(file, bytes.data() + offset, bytes.size() - offset);
+        if (count == -1 && errno == EINTR) {
+            continue;
+        }
+        written = count > 0;
+        offset += written ? static_cast<size_t>(count) : 0;
+    }
+    written = ::fsync(file) == 0 && written;
+    written = ::close(file) == 0 && written;
+#endif
+    if (!written) {
+        throw std::runtime_error{ "failed to write file " + path.string() };
+    }
+}
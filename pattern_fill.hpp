@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+
+#include "bit_repack.hpp"
+#include "thread_pool.hpp"
+
+// Input patterns for storage buffers. Word i of a pattern is a pure function
+// of i, so a buffer can be filled in independent pieces on several threads,
+// and a checker can recompute any word without the buffer:
+//
+// iota:     value + i
+// random:   a counter based hash of i and seed
+// constant: value
+// file:     words[i % words.size()], the words of a pattern file repeated
+//
+// The avx2 tier writes with non temporal stores, which skip the cache on the
+// way to the mostly write combined memory staging buffers are mapped from.
+namespace pattern_fill {
+    enum class pattern_kind {
+        iota,
+        random,
+        constant,
+        file,
+    };
+
+    inline std::string_view to_string(pattern_kind kind) {
+        switch (kind) {
+        case pattern_kind::random:
+            return "random";
+        case pattern_kind::constant:
+            return "constant";
+        case pattern_kind::file:
+            return "file";
+        default:
+            return "iota";
+        }
+    }
+
+    struct pattern {
+        pattern_kind kind = pattern_kind::iota;
+        // start of iota, word of constant
+        uint32_t value = 0;
+        uint64_t seed = 0;
+        // the file pattern, which must outlive the fills
+        std::span<const uint32_t> words;
+    };
+
+    // lowbias32 by Chris Wellons, a bijection on 32 bits
+    constexpr uint32_t mix32(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // random words of the same 2^32 word segment share a key, so the vector
+    // tier only hashes the low half of the index
+    constexpr uint32_t random_key(uint64_t seed, uint64_t index) {
+        return mix32(static_cast<uint32_t>(seed) ^
+            mix32(static_cast<uint32_t>(seed >> 32) + static_cast<uint32_t>(index >> 32)));
+    }
+
+    constexpr uint32_t random_word(uint64_t seed, uint64_t index) {
+        return mix32(static_cast<uint32_t>(index) ^ random_key(seed, index));
+    }
+
+    inline void check_pattern(const pattern& pattern) {
+        if (pattern.kind == pattern_kind::file && pattern.words.empty()) {
+            throw std::runtime_error{ "empty pattern file" };
+        }
+    }
+
+    inline uint32_t word_at(const pattern& pattern, uint64_t index) {
+        switch (pattern.kind) {
+        case pattern_kind::random:
+            return random_word(pattern.seed, index);
+        case pattern_kind::constant:
+            return pattern.value;
+        case pattern_kind::file:
+            return pattern.words[index % pattern.words.size()];
+        default:
+            return pattern.value + static_cast<uint32_t>(index);
+        }
+    }
+
+    // fills dst with words [first, first + count) of the pattern
+    inline void fill_scalar(const pattern& pattern, uint64_t first, uint32_t* dst, size_t count) {
+        switch (pattern.kind) {
+        case pattern_kind::random:
+            for (size_t i = 0; i < count; i++) {
+                dst[i] = random_word(pattern.seed, first + i);
+            }
+            break;
+        case pattern_kind::constant:
+            std::fill_n(dst, count, pattern.value);
+            break;
+        case pattern_kind::file:
+            for (size_t i = 0, offset = first % pattern.words.size(); i < count;) {
+                auto run = std::min(count - i, pattern.words.size() - offset);
+                std::memcpy(dst + i, pattern.words.data() + offset, run * sizeof(uint32_t));
+                i += run;
+                offset = 0;
+            }
+            break;
+        default:
+            for (size_t i = 0; i < count; i++) {
+                dst[i] = pattern.value + static_cast<uint32_t>(first + i);
+            }
+            break;
+        }
+    }
+
+#ifdef BIT_REPACK_X86
+    BIT_REPACK_TARGET("avx2")
+    inline __m256i mix32_avx2(__m256i x) {
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+        x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7feb352d));
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+        x = _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int>(0x846ca68bu)));
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+        return x;
+    }
+
+    // the stores need 32 byte alignment, so the scalar tier writes the words
+    // before the first aligned one and the tail
+    BIT_REPACK_TARGET("avx2")
+    inline void fill_avx2(const pattern& pattern, uint64_t first, uint32_t* dst, size_t count) {
+        auto head = std::min(count, (32 - reinterpret_cast<uintptr_t>(dst) % 32) % 32 / sizeof(uint32_t));
+        if (reinterpret_cast<uintptr_t>(dst) % sizeof(uint32_t) != 0) {
+            head = count;
+        }
+        fill_scalar(pattern, first, dst, head);
+        const size_t vector_count = (count - head) / 8;
+        auto out = reinterpret_cast<__m256i*>(dst + head);
+        uint64_t index = first + head;
+        const auto lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        switch (pattern.kind) {
+        case pattern_kind::random: {
+            auto segment = index >> 32;
+            auto key = _mm256_set1_epi32(static_cast<int>(random_key(pattern.seed, index)));
+            alignas(32) uint32_t crossing[8];
+            for (size_t v = 0; v < vector_count; v++, index += 8) {
+                if ((index + 7) >> 32 != index >> 32) {
+                    fill_scalar(pattern, index, crossing, 8);
+                    _mm256_stream_si256(out + v, _mm256_load_si256(reinterpret_cast<const __m256i*>(crossing)));
+                    continue;
+                }
+                if (index >> 32 != segment) {
+                    segment = index >> 32;
+                    key = _mm256_set1_epi32(static_cast<int>(random_key(pattern.seed, index)));
+                }
+                auto counter = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(index)), lanes);
+                _mm256_stream_si256(out + v, mix32_avx2(_mm256_xor_si256(counter, key)));
+            }
+            break;
+        }
+        case pattern_kind::constant: {
+            auto value = _mm256_set1_epi32(static_cast<int>(pattern.value));
+            for (size_t v = 0; v < vector_count; v++) {
+                _mm256_stream_si256(out + v, value);
+            }
+            break;
+        }
+        case pattern_kind::file: {
+            auto offset = index % pattern.words.size();
+            alignas(32) uint32_t wrapped[8];
+            for (size_t v = 0; v < vector_count; v++) {
+                __m256i words;
+                if (offset + 8 <= pattern.words.size()) {
+                    words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern.words.data() + offset));
+                    offset += 8;
+                }
+                else {
+                    for (auto& word : wrapped) {
+                        word = pattern.words[offset];
+                        offset = offset + 1 == pattern.words.size() ? 0 : offset + 1;
+                    }
+                    words = _mm256_load_si256(reinterpret_cast<const __m256i*>(wrapped));
+                }
+                if (offset == pattern.words.size()) {
+                    offset = 0;
+                }
+                _mm256_stream_si256(out + v, words);
+            }
+            break;
+        }
+        default: {
+            auto value = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(pattern.value + static_cast<uint32_t>(index))), lanes);
+            const auto step = _mm256_set1_epi32(8);
+            for (size_t v = 0; v < vector_count; v++) {
+                _mm256_stream_si256(out + v, value);
+                value = _mm256_add_epi32(value, step);
+            }
+            break;
+        }
+        }
+        // non temporal stores are weakly ordered, fence them before the
+        // buffer is handed to the device
+        _mm_sfence();
+        auto done = head + vector_count * 8;
+        fill_scalar(pattern, first + done, dst + done, count - done);
+    }
+#endif
+
+    using fill_function = void (*)(const pattern&, uint64_t, uint32_t*, size_t);
+
+    inline fill_function get_fill_function(bit_repack::isa level) {
+        if (!bit_repack::is_supported(level)) {
+            throw std::runtime_error{ "pattern fill isa not supported on this cpu" };
+        }
+#ifdef BIT_REPACK_X86
+        if (level == bit_repack::isa::avx2 || level == bit_repack::isa::avx512_vbmi) {
+            return fill_avx2;
+        }
+#endif
+        return fill_scalar;
+    }
+
+    inline fill_function get_best_fill_function() {
+        static const auto function = get_fill_function(bit_repack::best_supported_isa());
+        return function;
+    }
+
+    // fills dst with words [first, first + dst.size()) of the pattern
+    inline void fill(const pattern& pattern, std::span<uint32_t> dst, uint64_t first = 0) {
+        check_pattern(pattern);
+        get_best_fill_function()(pattern, first, dst.data(), dst.size());
+    }
+
+    // parts smaller than this are not worth waking a thread for
+    constexpr size_t min_part_words = size_t{ 1 } << 18;
+
+    // splits dst into one part per thread, each a multiple of 64 bytes long
+    inline void fill(thread_pool& pool, const pattern& pattern, std::span<uint32_t> dst, uint64_t first = 0,
+        fill_function function = get_best_fill_function()) {
+        check_pattern(pattern);
+        constexpr size_t part_alignment = 64 / sizeof(uint32_t);
+        auto part_words = std::max(min_part_words, (dst.size() / pool.get_thread_count() + part_alignment - 1) / part_alignment * part_alignment);
+        auto part_count = (dst.size() + part_words - 1) / part_words;
+        pool.run(part_count, [&](size_t part) {
+            auto offset = part * part_words;
+            auto count = std::min(part_words, dst.size() - offset);
+            function(pattern, first + offset, dst.data() + offset, count);
+        });
+    }
+}
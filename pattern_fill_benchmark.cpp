@@ -0,0 +1,62 @@
+// Host fill throughput of every input pattern: the scalar tier on one thread,
+// the widest tier the cpu supports on one thread and on the whole pool. The
+// file pattern repeats a 4 KiB random block. Every run is checked against
+// word_at.
+//
+// usage: pattern_fill_benchmark [words] [iterations] [threads]
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pattern_fill.hpp"
+
+int main(int argc, char** argv) {
+    try {
+        size_t count = argc > 1 ? std::stoull(argv[1]) : size_t{ 1 } << 26;
+        uint64_t iterations = argc > 2 ? std::stoull(argv[2]) : 10;
+        size_t thread_count = argc > 3 ? std::stoull(argv[3]) : std::thread::hardware_concurrency();
+
+        thread_pool pool{ thread_count };
+        auto file_words = std::vector<uint32_t>(1024);
+        pattern_fill::fill({ .kind = pattern_fill::pattern_kind::random, .seed = 1 }, file_words);
+        auto dst = std::vector<uint32_t>(count);
+        auto best = bit_repack::best_supported_isa();
+        auto best_fill = pattern_fill::get_best_fill_function();
+
+        std::cout << std::format("words: {}, {} bytes, {} thread(s), best tier {}",
+            count, count * sizeof(uint32_t), pool.get_thread_count(),
+            best_fill == pattern_fill::fill_scalar ? "scalar" : "avx2") << std::endl;
+        for (auto kind : { pattern_fill::pattern_kind::iota, pattern_fill::pattern_kind::random,
+            pattern_fill::pattern_kind::constant, pattern_fill::pattern_kind::file }) {
+            auto pattern = pattern_fill::pattern{ .kind = kind, .value = 7, .seed = 42, .words = file_words };
+            auto measure = [&](std::string_view name, auto&& fill) {
+                fill();
+                auto start = std::chrono::steady_clock::now();
+                for (uint64_t i = 0; i < iterations; i++) {
+                    fill();
+                }
+                auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - start };
+                bool match = true;
+                for (size_t t = 0; t < count && match; t++) {
+                    match = dst[t] == pattern_fill::word_at(pattern, t);
+                }
+                std::cout << std::format("{:>9} {:>16}: {:.2f} GB/s{}", pattern_fill::to_string(kind), name,
+                    count * sizeof(uint32_t) * iterations / elapsed.count() / 1e9,
+                    match ? "" : ", MISMATCH") << std::endl;
+            };
+            measure("scalar", [&] { pattern_fill::fill_scalar(pattern, 0, dst.data(), dst.size()); });
+            if (best != bit_repack::isa::scalar) {
+                measure("best tier", [&] { best_fill(pattern, 0, dst.data(), dst.size()); });
+            }
+            measure("best tier, pool", [&] { pattern_fill::fill(pool, pattern, dst); });
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "bit_repack.hpp"
+
+// Host reference of pixel_pack.comp. Unpacked pixels are planar 16 bit
+// containers, plane c of a frame of n pixels starting at container c * n, with
+// the sample in the low bits. Packed pixels are a dense stream of bits wide
+// samples, the channels of a pixel interleaved. With lsb_first sample bit 0
+// comes first and stream bit b is bit b % 8 of byte b / 8; with msb_first the
+// sample's top bit comes first and stream bit b is bit 7 - b % 8 of byte b / 8,
+// the usual layout of packed video formats.
+//
+// Packing leaves the bits of a trailing partial byte past the last sample
+// untouched, like the kernel does.
+namespace pixel_pack {
+    enum class bit_order {
+        lsb_first,
+        msb_first,
+    };
+
+    enum class direction {
+        pack,
+        unpack,
+    };
+
+    struct format {
+        uint32_t bits = 10;
+        uint32_t channels = 1;
+        bit_order order = bit_order::lsb_first;
+    };
+
+    inline std::string to_string(const format& format) {
+        return std::to_string(format.bits) + " bit x" + std::to_string(format.channels) +
+            (format.order == bit_order::msb_first ? " msb first" : " lsb first");
+    }
+    inline std::string to_string(direction direction) {
+        return direction == direction::pack ? "pack" : "unpack";
+    }
+
+    constexpr size_t packed_size(const format& format, size_t pixel_count) {
+        return (pixel_count * format.channels * format.bits + 7) / 8;
+    }
+
+    inline void check_format(const format& format) {
+        if (format.bits == 0 || format.bits > 16 || format.channels == 0) {
+            throw std::runtime_error{ "unsupported pixel format" };
+        }
+    }
+
+    // pixel count is planes.size() / channels
+    inline void pack(const format& format, std::span<const uint16_t> planes, std::span<std::byte> packed) {
+        check_format(format);
+        const size_t pixel_count = planes.size() / format.channels;
+        if (packed.size() < packed_size(format, pixel_count)) {
+            throw std::runtime_error{ "pixel pack destination too small" };
+        }
+        if (format.order == bit_order::lsb_first && format.bits == bit_repack::dst_stride_bits && format.channels == 1) {
+            bit_repack::repack(planes.first(pixel_count), packed);
+            return;
+        }
+        const uint32_t mask = (1u << format.bits) - 1;
+        const bool msb_first = format.order == bit_order::msb_first;
+        uint64_t bits = 0;
+        uint32_t bit_count = 0;
+        auto out = packed.data();
+        for (size_t p = 0; p < pixel_count; p++) {
+            for (uint32_t c = 0; c < format.channels; c++) {
+                uint64_t sample = planes[c * pixel_count + p] & mask;
+                if (msb_first) {
+                    bits = (bits << format.bits) | sample;
+                    bit_count += format.bits;
+                    for (; bit_count >= 8; bit_count -= 8) {
+                        *out++ = static_cast<std::byte>(bits >> (bit_count - 8));
+                    }
+                }
+                else {
+                    bits |= sample << bit_count;
+                    bit_count += format.bits;
+                    for (; bit_count >= 8; bit_count -= 8, bits >>= 8) {
+                        *out++ = static_cast<std::byte>(bits);
+                    }
+                }
+            }
+        }
+        if (bit_count > 0) {
+            auto old = static_cast<uint8_t>(*out);
+            auto byte = msb_first ?
+                (old & (0xffu >> bit_count)) | static_cast<uint8_t>(bits << (8 - bit_count)) :
+                (old & (0xffu << bit_count)) | static_cast<uint8_t>(bits);
+            *out = static_cast<std::byte>(byte);
+        }
+    }
+
+    // pixel count is planes.size() / channels, trailing containers are left untouched
+    inline void unpack(const format& format, std::span<const std::byte> packed, std::span<uint16_t> planes) {
+        check_format(format);
+        const size_t pixel_count = planes.size() / format.channels;
+        if (packed.size() < packed_size(format, pixel_count)) {
+            throw std::runtime_error{ "pixel unpack source too small" };
+        }
+        const uint32_t mask = (1u << format.bits) - 1;
+        const bool msb_first = format.order == bit_order::msb_first;
+        uint64_t bits = 0;
+        uint32_t bit_count = 0;
+        auto in = packed.data();
+        for (size_t p = 0; p < pixel_count; p++) {
+            for (uint32_t c = 0; c < format.channels; c++) {
+                uint32_t sample;
+                if (msb_first) {
+                    for (; bit_count < format.bits; bit_count += 8) {
+                        bits = (bits << 8) | static_cast<uint8_t>(*in++);
+                    }
+                    bit_count -= format.bits;
+                    sample = static_cast<uint32_t>(bits >> bit_count) & mask;
+                }
+                else {
+                    for (; bit_count < format.bits; bit_count += 8) {
+                        bits |= uint64_t{ static_cast<uint8_t>(*in++) } << bit_count;
+                    }
+                    sample = static_cast<uint32_t>(bits) & mask;
+                    bits >>= format.bits;
+                    bit_count -= format.bits;
+                }
+                planes[c * pixel_count + p] = static_cast<uint16_t>(sample);
+            }
+        }
+    }
+}
@@ -0,0 +1,100 @@
+// Packs and unpacks 10, 12 and 14 bit samples, lsb and msb first, with one
+// and three interleaved channels, on the GPU with pixel_pack.comp and on the
+// CPU with the pixel_pack reference. Reports GB/s of 16 bit containers for
+// both and checks the GPU output against the CPU one.
+//
+// usage: pixel_pack_benchmark [iterations]
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <random>
+#include <string>
+#include <vulkan/vulkan.h>
+#include "compute_app.hpp"
+#include "pixel_pack.hpp"
+#include "latency_histogram.hpp"
+
+constexpr uint32_t container_count = 1u << 20;
+
+class pixel_pack_benchmark : public pixel_pack_engine<vulkan_helper::storage_location::host_visible, container_count> {
+public:
+    using parent = pixel_pack_engine<vulkan_helper::storage_location::host_visible, container_count>;
+
+    void run(const pixel_pack::format& format, pixel_pack::direction direction, uint64_t iterations) {
+        auto sizes = parent::get_storage_buffer_sizes();
+        auto ptrs = parent::get_storage_memory_ptrs();
+        auto packed = std::span{ static_cast<std::byte*>(ptrs[0]), sizes[0] };
+        auto planes = std::span{ static_cast<uint16_t*>(ptrs[1]), sizes[1] / sizeof(uint16_t) };
+        auto pixel_count = planes.size() / format.channels;
+        auto samples = planes.first(pixel_count * format.channels);
+        bool pack = direction == pixel_pack::direction::pack;
+
+        auto random = std::mt19937{ format.bits };
+        auto input = pack ? std::as_writable_bytes(planes) : packed;
+        auto output = pack ? packed : std::as_writable_bytes(planes);
+        std::generate(input.begin(), input.end(), [&random] { return static_cast<std::byte>(random()); });
+        std::fill(output.begin(), output.end(), std::byte{ 0 });
+        parent::mark_host_written(packed.data(), packed.size());
+        parent::mark_host_written(planes.data(), planes.size_bytes());
+        parent::flush_host_writes();
+
+        parent::record(format, direction);
+        latency_histogram histogram{};
+        for (uint64_t i = 0; i < iterations; i++) {
+            parent::wait_for_value(parent::submit_timeline(parent::get_command_buffer()));
+            for (auto& region : parent::get_region_durations()) {
+                if (region.name == "dispatch") {
+                    histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(region.duration));
+                }
+            }
+        }
+        parent::mark_host_read(output.data(), output.size());
+        parent::invalidate_host_reads();
+
+        auto expected = std::vector<std::byte>(output.size());
+        auto cpu_iterations = std::max<uint64_t>(iterations / 10, 1);
+        auto begin = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < cpu_iterations; i++) {
+            if (pack) {
+                pixel_pack::pack(format, samples, expected);
+            }
+            else {
+                auto expected_planes = std::span{ reinterpret_cast<uint16_t*>(expected.data()), samples.size() };
+                pixel_pack::unpack(format, packed, expected_planes);
+            }
+        }
+        auto cpu_time = std::chrono::duration<double, std::nano>{ std::chrono::steady_clock::now() - begin } / cpu_iterations;
+        auto mismatches = std::inner_product(expected.begin(), expected.end(), output.begin(), size_t{ 0 },
+            std::plus<>{}, [](std::byte lhs, std::byte rhs) { return size_t{ lhs != rhs }; });
+
+        auto bytes = static_cast<double>(samples.size_bytes());
+        std::cout << std::format("{:>6} {:<20}: gpu {:.2f} us, {:.2f} GB/s, cpu {:.2f} GB/s, {}",
+            pixel_pack::to_string(direction), pixel_pack::to_string(format),
+            std::chrono::duration<double, std::micro>{ histogram.mean() }.count(),
+            bytes / histogram.mean().count(), bytes / cpu_time.count(),
+            mismatches == 0 ? std::string{ "matches cpu reference" } : std::format("{} mismatching byte(s)", mismatches)) << std::endl;
+    }
+};
+
+int main(int argc, char** argv) {
+    try {
+        uint64_t iterations = argc > 1 ? std::stoull(argv[1]) : 100;
+        pixel_pack_benchmark benchmark;
+        std::cout << std::format("containers: {}", container_count) << std::endl;
+        for (uint32_t bits : { 10u, 12u, 14u }) {
+            for (auto order : { pixel_pack::bit_order::lsb_first, pixel_pack::bit_order::msb_first }) {
+                for (uint32_t channels : { 1u, 3u }) {
+                    auto format = pixel_pack::format{ bits, channels, order };
+                    benchmark.run(format, pixel_pack::direction::pack, iterations);
+                    benchmark.run(format, pixel_pack::direction::unpack, iterations);
+                }
+            }
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+// CPU baseline for the test.comp repack: runs every tier of bit_repack the
+// cpu supports over the same input, checks it against the scalar tier and
+// reports throughput in GB/s of 16 bit input.
+//
+// usage: repack_benchmark [elements] [iterations]
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <numeric>
+#include <string>
+#include <vector>
+#include "bit_repack.hpp"
+
+int main(int argc, char** argv) {
+    try {
+        size_t count = argc > 1 ? std::stoull(argv[1]) : size_t{ 1 } << 24;
+        uint64_t iterations = argc > 2 ? std::stoull(argv[2]) : 20;
+
+        auto src = std::vector<uint16_t>(count);
+        std::iota(src.begin(), src.end(), uint16_t{ 0 });
+        auto expected = std::vector<std::byte>(bit_repack::packed_size(count));
+        bit_repack::repack(src, expected, bit_repack::isa::scalar);
+
+        std::cout << std::format("elements: {}, input: {} bytes, output: {} bytes, dispatch picks {}",
+            count, count * sizeof(uint16_t), expected.size(),
+            bit_repack::to_string(bit_repack::best_supported_isa())) << std::endl;
+        for (auto level : { bit_repack::isa::scalar, bit_repack::isa::bmi2, bit_repack::isa::avx2, bit_repack::isa::avx512_vbmi }) {
+            if (!bit_repack::is_supported(level)) {
+                std::cout << std::format("{:>12}: not supported", bit_repack::to_string(level)) << std::endl;
+                continue;
+            }
+            auto dst = std::vector<std::byte>(expected.size());
+            bit_repack::repack(src, dst, level);
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; i++) {
+                bit_repack::repack(src, dst, level);
+            }
+            auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - start };
+            std::cout << std::format("{:>12}: {:.2f} GB/s{}", bit_repack::to_string(level),
+                count * sizeof(uint16_t) * iterations / elapsed.count() / 1e9,
+                dst == expected ? "" : ", MISMATCH") << std::endl;
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
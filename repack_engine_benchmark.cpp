@@ -0,0 +1,92 @@
+// Runs test.comp for 10, 12 and 14 bit samples in 16 bit containers, each
+// once with a pipeline specialized for the width and once with the generic
+// push constant pipeline, and checks the output against a bit by bit CPU
+// reference. Specialized pipelines are built the first time a width is
+// recorded and come from the variant cache after that.
+//
+// usage: repack_engine_benchmark [iterations]
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <random>
+#include <string>
+#include <vulkan/vulkan.h>
+#include "compute_app.hpp"
+#include "latency_histogram.hpp"
+
+constexpr uint32_t element_count = 1u << 20;
+
+class repack_engine_benchmark : public repack_engine<vulkan_helper::storage_location::host_visible, element_count> {
+public:
+    using parent = repack_engine<vulkan_helper::storage_location::host_visible, element_count>;
+
+    void run(const repack_parameters& parameters, bool specialized, uint64_t iterations) {
+        auto sizes = parent::get_storage_buffer_sizes();
+        auto ptrs = parent::get_storage_memory_ptrs();
+        auto out = static_cast<uint32_t*>(ptrs[0]);
+        auto in = static_cast<uint32_t*>(ptrs[1]);
+        auto random = std::mt19937{ parameters.copy_bits };
+        std::fill(out, out + sizes[0] / sizeof(uint32_t), 0u);
+        std::generate(in, in + sizes[1] / sizeof(uint32_t), random);
+        parent::mark_host_written(out, sizes[0]);
+        parent::mark_host_written(in, sizes[1]);
+        parent::flush_host_writes();
+
+        parent::record(parameters, specialized);
+        latency_histogram histogram{};
+        for (uint64_t i = 0; i < iterations; i++) {
+            parent::wait_for_value(parent::submit_timeline(parent::get_command_buffer()));
+            for (auto& region : parent::get_region_durations()) {
+                if (region.name == "dispatch") {
+                    histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(region.duration));
+                }
+            }
+        }
+        parent::mark_host_read(out, sizes[0]);
+        parent::invalidate_host_reads();
+
+        auto expected = std::vector<uint32_t>(sizes[0] / sizeof(uint32_t));
+        auto count = parameters.element_count(sizes[1]);
+        for (uint64_t e = 0; e < count; e++) {
+            for (uint64_t i = 0; i < parameters.copy_bits; i++) {
+                auto src_bit = e * parameters.src_stride_bits + i;
+                auto dst_bit = e * parameters.dst_stride_bits + i;
+                auto bit = (in[src_bit / 32] >> (src_bit % 32)) & 1u;
+                expected[dst_bit / 32] |= bit << (dst_bit % 32);
+            }
+        }
+        auto mismatches = std::inner_product(expected.begin(), expected.end(), out, size_t{ 0 },
+            std::plus<>{}, [](uint32_t lhs, uint32_t rhs) { return size_t{ lhs != rhs }; });
+
+        auto us = [](auto duration) {
+            return std::chrono::duration<double, std::micro>{ duration }.count();
+        };
+        std::cout << std::format("{:>2} bit {:>11}: mean {:.2f} us, p50 {:.2f} us, p99 {:.2f} us, {:.2f} GB/s, {}",
+            parameters.copy_bits, specialized ? "specialized" : "generic",
+            us(histogram.mean()), us(histogram.percentile(0.5)), us(histogram.percentile(0.99)),
+            sizes[1] / histogram.mean().count(),
+            mismatches == 0 ? std::string{ "matches cpu reference" } : std::format("{} mismatching word(s)", mismatches)) << std::endl;
+    }
+};
+
+int main(int argc, char** argv) {
+    try {
+        uint64_t iterations = argc > 1 ? std::stoull(argv[1]) : 100;
+        repack_engine_benchmark benchmark;
+        std::cout << std::format("elements: {}", element_count) << std::endl;
+        for (uint32_t bits : { 10u, 12u, 14u }) {
+            auto parameters = repack_parameters{ 16, bits, bits };
+            benchmark.run(parameters, true, iterations);
+            benchmark.run(parameters, false, iterations);
+        }
+        std::cout << std::format("pipeline variants: {}, built in {:.2f} ms",
+            benchmark.get_pipeline_variant_count(),
+            std::chrono::duration<double, std::milli>{ benchmark.get_pipeline_creation_time() }.count()) << std::endl;
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Compares the atomic scatter formulation of the repack kernel (test.comp)
+// with the atomic free gather formulation (test_gather.comp) and the
+// subgroup formulation (test_subgroup.comp) on the same random input, and
+// test.comp with its buffers reached through device addresses
+// (test_bda.comp). Times come from the "dispatch" timestamp region; every
+// result is checked against the bit_repack CPU reference.
+//
+// usage: repack_kernel_benchmark [iterations]
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <random>
+#include <string>
+#include <vulkan/vulkan.h>
+#include "compute_app.hpp"
+#include "bit_repack.hpp"
+#include "latency_histogram.hpp"
+
+constexpr uint32_t element_count = 1u << 20;
+
+template<class Kernel>
+using kernel_app = basic_compute_app<vulkan_helper::storage_location::host_visible, Kernel, element_count>;
+
+template<class App>
+class repack_kernel_benchmark : public App {
+public:
+    using parent = App;
+
+    void run(const char* name, uint64_t iterations) {
+        auto sizes = parent::get_storage_buffer_sizes();
+        auto ptrs = parent::get_storage_memory_ptrs();
+        auto out = static_cast<uint32_t*>(ptrs[0]);
+        auto in = static_cast<uint32_t*>(ptrs[1]);
+        auto random = std::mt19937{ 1 };
+        std::fill(out, out + sizes[0] / sizeof(uint32_t), 0u);
+        std::generate(in, in + sizes[1] / sizeof(uint32_t), random);
+        parent::mark_host_written(out, sizes[0]);
+        parent::mark_host_written(in, sizes[1]);
+        parent::flush_host_writes();
+
+        latency_histogram histogram{};
+        for (uint64_t i = 0; i < iterations; i++) {
+            parent::wait_for_value(parent::submit_timeline(parent::get_command_buffer()));
+            for (auto& region : parent::get_region_durations()) {
+                if (region.name == "dispatch") {
+                    histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(region.duration));
+                }
+            }
+        }
+        parent::mark_host_read(out, sizes[0]);
+        parent::invalidate_host_reads();
+
+        auto expected = std::vector<uint32_t>(sizes[0] / sizeof(uint32_t));
+        bit_repack::repack(std::span{ reinterpret_cast<const uint16_t*>(in), element_count },
+            std::as_writable_bytes(std::span{ expected }));
+        auto mismatches = std::inner_product(expected.begin(), expected.end(), out, size_t{ 0 },
+            std::plus<>{}, [](uint32_t lhs, uint32_t rhs) { return size_t{ lhs != rhs }; });
+
+        auto us = [](auto duration) {
+            return std::chrono::duration<double, std::micro>{ duration }.count();
+        };
+        std::cout << std::format("{:>8}: mean {:.2f} us, p50 {:.2f} us, p99 {:.2f} us, {:.2f} GB/s, {}",
+            name, us(histogram.mean()), us(histogram.percentile(0.5)), us(histogram.percentile(0.99)),
+            sizes[1] / histogram.mean().count(),
+            mismatches == 0 ? std::string{ "matches cpu reference" } : std::format("{} mismatching word(s)", mismatches)) << std::endl;
+    }
+};
+
+int main(int argc, char** argv) {
+    try {
+        uint64_t iterations = argc > 1 ? std::stoull(argv[1]) : 100;
+        std::cout << std::format("elements: {}", element_count) << std::endl;
+        {
+            repack_kernel_benchmark<kernel_app<repack_atomic_kernel>> benchmark;
+            benchmark.run("atomic", iterations);
+        }
+        {
+            repack_kernel_benchmark<kernel_app<repack_gather_kernel>> benchmark;
+            benchmark.run("gather", iterations);
+        }
+        {
+            repack_kernel_benchmark<kernel_app<repack_subgroup_kernel>> benchmark;
+            auto subgroup = benchmark.get_subgroup_properties();
+            std::cout << std::format("subgroup size: {}, min {}, max {}, required size in compute: {}",
+                subgroup.size, subgroup.min_size, subgroup.max_size,
+                subgroup.choose_required_size(repack_subgroup_kernel::preferred_subgroup_size)) << std::endl;
+            benchmark.run("subgroup", iterations);
+        }
+        {
+            repack_kernel_benchmark<basic_buffer_address_compute_app<vulkan_helper::storage_location::host_visible, element_count>> benchmark;
+            benchmark.run("address", iterations);
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
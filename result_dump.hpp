@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "bit_repack.hpp"
+#include "mmaped_file.hpp"
+
+// Dumps result buffers either as hex text, a separator line and then rows of
+// eight "0x%08x, " words like the std::format loop it replaces, or as the raw
+// little endian words. Text is formatted into large chunks that go out with
+// one fwrite each, or straight into a mapped output file.
+namespace result_dump {
+    enum class format {
+        hex,
+        binary,
+    };
+
+    constexpr std::string_view separator = "-----------------------------------------------\n";
+    constexpr size_t row_words = 8;
+    // "0x", eight digits, ", "
+    constexpr size_t hex_word_size = 12;
+    constexpr size_t hex_row_size = row_words * hex_word_size + 1;
+
+    // every full row ends with a newline, and the section with one more
+    constexpr size_t hex_text_size(size_t word_count) {
+        return word_count * hex_word_size + word_count / row_words + 1;
+    }
+    constexpr size_t section_size(format format, size_t word_count) {
+        return format == format::hex ? separator.size() + hex_text_size(word_count) : word_count * sizeof(uint32_t);
+    }
+
+    inline char* format_hex_word(uint32_t word, char* out) {
+        static constexpr char digits[] = "0123456789abcdef";
+        out[0] = '0';
+        out[1] = 'x';
+        for (int i = 0; i < 8; i++) {
+            out[2 + i] = digits[(word >> (28 - 4 * i)) & 0xf];
+        }
+        out[10] = ',';
+        out[11] = ' ';
+        return out + hex_word_size;
+    }
+
+    inline char* format_hex_rows_scalar(const uint32_t* words, size_t row_count, char* out) {
+        for (size_t r = 0; r < row_count; r++) {
+            for (size_t k = 0; k < row_words; k++) {
+                out = format_hex_word(words[r * row_words + k], out);
+            }
+            *out++ = '\n';
+        }
+        return out;
+    }
+
+#ifdef BIT_REPACK_X86
+    // a row of eight words is one register: byte swap every word so its top
+    // byte comes first, split the bytes into nibbles and look the digits up
+    BIT_REPACK_TARGET("avx2")
+    inline char* format_hex_rows_avx2(const uint32_t* words, size_t row_count, char* out) {
+        const __m256i swap = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        const __m256i digits = _mm256_setr_epi8(
+            '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+            '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+        const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+        alignas(32) char hex[64];
+        for (size_t r = 0; r < row_count; r++) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + r * row_words));
+            v = _mm256_shuffle_epi8(v, swap);
+            auto high = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble_mask);
+            auto low = _mm256_and_si256(v, nibble_mask);
+            // words 0, 1 | 4, 5 and 2, 3 | 6, 7, back in order after the lane permutes
+            auto first = _mm256_shuffle_epi8(digits, _mm256_unpacklo_epi8(high, low));
+            auto second = _mm256_shuffle_epi8(digits, _mm256_unpackhi_epi8(high, low));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(hex), _mm256_permute2x128_si256(first, second, 0x20));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(hex + 32), _mm256_permute2x128_si256(first, second, 0x31));
+            for (size_t k = 0; k < row_words; k++) {
+                std::memcpy(out, "0x", 2);
+                std::memcpy(out + 2, hex + 8 * k, 8);
+                std::memcpy(out + 10, ", ", 2);
+                out += hex_word_size;
+            }
+            *out++ = '\n';
+        }
+        return out;
+    }
+#endif
+
+    using format_hex_rows_function = char* (*)(const uint32_t*, size_t, char*);
+
+    inline format_hex_rows_function get_format_hex_rows_function() {
+#ifdef BIT_REPACK_X86
+        if (bit_repack::is_supported(bit_repack::isa::avx2)) {
+            return format_hex_rows_avx2;
+        }
+#endif
+        return format_hex_rows_scalar;
+    }
+
+    // formats the words without separator and final newline, continuing a
+    // section whose earlier words filled whole rows
+    inline char* format_hex(std::span<const uint32_t> words, char* out) {
+        static const auto format_hex_rows = get_format_hex_rows_function();
+        auto row_count = words.size() / row_words;
+        out = format_hex_rows(words.data(), row_count, out);
+        for (size_t t = row_count * row_words; t < words.size(); t++) {
+            out = format_hex_word(words[t], out);
+        }
+        return out;
+    }
+
+    // writes a whole section to out, which must hold section_size bytes
+    inline char* write_section(format format, std::span<const uint32_t> words, char* out) {
+        if (format == format::binary) {
+            if (!words.empty()) {
+                std::memcpy(out, words.data(), words.size_bytes());
+            }
+            return out + words.size_bytes();
+        }
+        std::memcpy(out, separator.data(), separator.size());
+        out = format_hex(words, out + separator.size());
+        *out++ = '\n';
+        return out;
+    }
+
+    // Streams sections to a FILE through a chunk buffer, one fwrite per chunk;
+    // binary sections skip the buffer and go out with a single fwrite.
+    class stream_dumper {
+    public:
+        static constexpr size_t default_chunk_size = size_t{ 1 } << 20;
+
+        explicit stream_dumper(std::FILE* file, size_t chunk_size = default_chunk_size) :
+            m_file{ file },
+            m_chunk(std::max(chunk_size, hex_row_size + separator.size()))
+        {}
+        stream_dumper(const stream_dumper&) = delete;
+        stream_dumper& operator=(const stream_dumper&) = delete;
+        ~stream_dumper() {
+            if (m_used > 0) {
+                std::fwrite(m_chunk.data(), 1, m_used, m_file);
+            }
+            std::fflush(m_file);
+        }
+
+        void dump(format format, std::span<const uint32_t> words) {
+            if (format == format::binary) {
+                flush();
+                write(words.data(), words.size_bytes());
+                return;
+            }
+            append(separator.data(), separator.size());
+            const size_t rows_per_chunk = m_chunk.size() / hex_row_size;
+            while (!words.empty()) {
+                if (m_chunk.size() - m_used < hex_row_size) {
+                    flush();
+                }
+                auto rows = std::min((m_chunk.size() - m_used) / hex_row_size, rows_per_chunk);
+                auto count = std::min(words.size(), rows * row_words);
+                auto end = format_hex(words.first(count), m_chunk.data() + m_used);
+                m_used = end - m_chunk.data();
+                words = words.subspan(count);
+            }
+            append("\n", 1);
+        }
+        void flush() {
+            if (m_used > 0) {
+                write(m_chunk.data(), m_used);
+                m_used = 0;
+            }
+            if (std::fflush(m_file) != 0) {
+                throw std::runtime_error{ "failed to flush dump output" };
+            }
+        }
+    private:
+        void append(const char* data, size_t size) {
+            if (m_chunk.size() - m_used < size) {
+                flush();
+            }
+            std::memcpy(m_chunk.data() + m_used, data, size);
+            m_used += size;
+        }
+        void write(const void* data, size_t size) {
+            if (size > 0 && std::fwrite(data, 1, size, m_file) != size) {
+                throw std::runtime_error{ "failed to write dump output" };
+            }
+        }
+
+        std::FILE* m_file;
+        std::vector<char> m_chunk;
+        size_t m_used = 0;
+    };
+
+    // Sizes the file for all sections up front and formats them in place.
+    inline void dump_to_file(const std::filesystem::path& path, format format,
+        std::span<const std::span<const uint32_t>> sections) {
+        uint64_t size = 0;
+        for (auto& words : sections) {
+            size += section_size(format, words.size());
+        }
+        auto file = mmaped_output_file{ path, size };
+        auto out = reinterpret_cast<char*>(file.data());
+        for (auto& words : sections) {
+            out = write_section(format, words, out);
+        }
+    }
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bit_repack.hpp"
+#include "mmaped_file.hpp"
+#include "thread_pool.hpp"
+
+// Compares result words against golden words. Bit b of word t is bit
+// 32 * t + b, the lsb first numbering of the packed streams. Blocks of words
+// that match are skipped with one vector test each, so checking a buffer that
+// passes costs about as much as reading both; only blocks with a difference
+// go through the scalar code that counts and records mismatches.
+namespace result_verify {
+    struct report {
+        uint64_t word_count = 0;
+        uint64_t mismatching_word_count = 0;
+        uint64_t mismatching_bit_count = 0;
+        // ascending, at most the max_reported_bits passed to compare
+        std::vector<uint64_t> first_mismatching_bits;
+
+        bool passed() const {
+            return mismatching_word_count == 0;
+        }
+        // appends the report of the words right after this report's
+        void merge(const report& next, size_t max_reported_bits) {
+            word_count += next.word_count;
+            mismatching_word_count += next.mismatching_word_count;
+            mismatching_bit_count += next.mismatching_bit_count;
+            for (auto bit : next.first_mismatching_bits) {
+                if (first_mismatching_bits.size() >= max_reported_bits) {
+                    break;
+                }
+                first_mismatching_bits.push_back(bit);
+            }
+        }
+    };
+
+    inline std::string to_string(const report& report) {
+        if (report.passed()) {
+            return "match";
+        }
+        auto text = std::to_string(report.mismatching_word_count) + " mismatching word(s), " +
+            std::to_string(report.mismatching_bit_count) + " bit(s), first at bit";
+        for (auto bit : report.first_mismatching_bits) {
+            text += " " + std::to_string(bit);
+        }
+        return text;
+    }
+
+    // expected and actual hold count words, the first being word first_word of the buffer
+    inline void record_mismatches(const uint32_t* expected, const uint32_t* actual, size_t count,
+        uint64_t first_word, size_t max_reported_bits, report& report) {
+        for (size_t t = 0; t < count; t++) {
+            auto difference = expected[t] ^ actual[t];
+            if (difference == 0) {
+                continue;
+            }
+            report.mismatching_word_count++;
+            report.mismatching_bit_count += std::popcount(difference);
+            for (; difference != 0 && report.first_mismatching_bits.size() < max_reported_bits; difference &= difference - 1) {
+                report.first_mismatching_bits.push_back((first_word + t) * 32 + std::countr_zero(difference));
+            }
+        }
+    }
+
+    inline void compare_scalar(const uint32_t* expected, const uint32_t* actual, size_t count,
+        uint64_t first_word, size_t max_reported_bits, report& report) {
+        constexpr size_t block_words = 32;
+        size_t t = 0;
+        for (; t + block_words <= count; t += block_words) {
+            uint32_t difference = 0;
+            for (size_t k = 0; k < block_words; k++) {
+                difference |= expected[t + k] ^ actual[t + k];
+            }
+            if (difference != 0) {
+                record_mismatches(expected + t, actual + t, block_words, first_word + t, max_reported_bits, report);
+            }
+        }
+        record_mismatches(expected + t, actual + t, count - t, first_word + t, max_reported_bits, report);
+        report.word_count += count;
+    }
+
+#ifdef BIT_REPACK_X86
+    // four vectors a block, xored and ored into one test
+    BIT_REPACK_TARGET("avx2")
+    inline void compare_avx2(const uint32_t* expected, const uint32_t* actual, size_t count,
+        uint64_t first_word, size_t max_reported_bits, report& report) {
+        constexpr size_t block_words = 32;
+        size_t t = 0;
+        for (; t + block_words <= count; t += block_words) {
+            auto difference = _mm256_setzero_si256();
+            for (size_t k = 0; k < block_words; k += 8) {
+                auto e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(expected + t + k));
+                auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(actual + t + k));
+                difference = _mm256_or_si256(difference, _mm256_xor_si256(e, a));
+            }
+            if (!_mm256_testz_si256(difference, difference)) {
+                record_mismatches(expected + t, actual + t, block_words, first_word + t, max_reported_bits, report);
+            }
+        }
+        record_mismatches(expected + t, actual + t, count - t, first_word + t, max_reported_bits, report);
+        report.word_count += count;
+    }
+#endif
+
+    using compare_function = void (*)(const uint32_t*, const uint32_t*, size_t, uint64_t, size_t, report&);
+
+    inline compare_function get_compare_function(bit_repack::isa level) {
+        if (!bit_repack::is_supported(level)) {
+            throw std::runtime_error{ "result verify isa not supported on this cpu" };
+        }
+#ifdef BIT_REPACK_X86
+        if (level == bit_repack::isa::avx2 || level == bit_repack::isa::avx512_vbmi) {
+            return compare_avx2;
+        }
+#endif
+        return compare_scalar;
+    }
+
+    inline compare_function get_best_compare_function() {
+        static const auto function = get_compare_function(bit_repack::best_supported_isa());
+        return function;
+    }
+
+    inline void check_sizes(std::span<const uint32_t> expected, std::span<const uint32_t> actual) {
+        if (expected.size() != actual.size()) {
+            throw std::runtime_error{ "golden and result word counts differ" };
+        }
+    }
+
+    inline report compare(std::span<const uint32_t> expected, std::span<const uint32_t> actual,
+        size_t max_reported_bits = 16) {
+        check_sizes(expected, actual);
+        auto result = report{};
+        get_best_compare_function()(expected.data(), actual.data(), expected.size(), 0, max_reported_bits, result);
+        return result;
+    }
+
+    // parts smaller than this are not worth waking a thread for
+    constexpr size_t min_part_words = size_t{ 1 } << 18;
+
+    // one part per thread, every part keeps its own first bits and the
+    // reports are merged in buffer order
+    inline report compare(thread_pool& pool, std::span<const uint32_t> expected, std::span<const uint32_t> actual,
+        size_t max_reported_bits = 16, compare_function function = get_best_compare_function()) {
+        check_sizes(expected, actual);
+        auto part_words = std::max(min_part_words, (expected.size() + pool.get_thread_count() - 1) / pool.get_thread_count());
+        auto part_count = (expected.size() + part_words - 1) / part_words;
+        auto reports = std::vector<report>(part_count);
+        pool.run(part_count, [&](size_t part) {
+            auto offset = part * part_words;
+            auto count = std::min(part_words, expected.size() - offset);
+            function(expected.data() + offset, actual.data() + offset, count, offset, max_reported_bits, reports[part]);
+        });
+        auto result = report{};
+        for (auto& part : reports) {
+            result.merge(part, max_reported_bits);
+        }
+        return result;
+    }
+
+    // the first word_count words of a golden file; a file written by a binary
+    // dump holds every buffer of a frame, the first one at its start
+    inline std::span<const uint32_t> golden_words(const mmaped_file& file, size_t word_count) {
+        if (file.size() < word_count * sizeof(uint32_t)) {
+            throw std::runtime_error{ "golden file smaller than the result" };
+        }
+        return { reinterpret_cast<const uint32_t*>(file.data()), word_count };
+    }
+}
@@ -1,40 +1,554 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
+#include <array>
 #include <filesystem>
 #include <cassert>
+#include <stdexcept>
+#include <cstdint>
+#include <span>
+#include <vulkan/vulkan.h>
 
-#include <Windows.h>
+#include "mmaped_file.hpp"
 
 class spirv_file {
 public:
-    spirv_file(std::filesystem::path path) {
-        hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-        assert(hFile != INVALID_HANDLE_VALUE);
-        hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-        assert(hFile != INVALID_HANDLE_VALUE);
-        mmaped_ptr = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
-        assert(mmaped_ptr != nullptr);
+    static constexpr uint32_t magic_number = 0x07230203;
+
+    spirv_file(std::filesystem::path path, mmap_options options = {}) : m_file{ path, options } {
+        if (m_file.size() % sizeof(uint32_t) != 0 || m_file.size() < 5 * sizeof(uint32_t) || data()[0] != magic_number) {
+            throw std::runtime_error{ "not a spirv file " + path.string() };
+        }
     }
     spirv_file(const spirv_file& file) = delete;
-    spirv_file(spirv_file&& file) = delete;
-    ~spirv_file() {
-        UnmapViewOfFile(mmaped_ptr);
-        CloseHandle(hMapping);
-        CloseHandle(hFile);
-    }
+    spirv_file(spirv_file&& file) = default;
     spirv_file& operator=(const spirv_file& file) = delete;
-    spirv_file& operator=(spirv_file&& file) = delete;
+    spirv_file& operator=(spirv_file&& file) = default;
 
     const uint32_t* data() const {
-        return static_cast<const uint32_t*>(mmaped_ptr);
+        return reinterpret_cast<const uint32_t*>(m_file.data());
     }
     size_t size() const {
-        return GetFileSize(hFile, NULL);
+        return static_cast<size_t>(m_file.size());
+    }
+    std::span<const uint32_t> words() const {
+        return { data(), size() / sizeof(uint32_t) };
+    }
+
+private:
+    mmaped_file m_file;
+};
+
+// What a pipeline layout needs to know about a module: its resources, push
+// constant block, specialization constants and workgroup size.
+struct spirv_reflection {
+    struct descriptor_binding {
+        uint32_t set;
+        uint32_t binding;
+        VkDescriptorType type;
+        // 0 for runtime sized arrays
+        uint32_t count;
+    };
+    struct specialization_constant {
+        uint32_t id;
+        // bytes, booleans are VkBool32
+        uint32_t size;
+    };
+    static constexpr uint32_t no_specialization = UINT32_MAX;
+
+    // sorted by set and binding
+    std::vector<descriptor_binding> bindings;
+    // sorted by id
+    std::vector<specialization_constant> specialization_constants;
+    // offset and size 0 without a push constant block
+    uint32_t push_constant_offset = 0;
+    uint32_t push_constant_size = 0;
+    // default workgroup size and the specialization constants overriding it
+    std::array<uint32_t, 3> local_size{ 1, 1, 1 };
+    std::array<uint32_t, 3> local_size_ids{ no_specialization, no_specialization, no_specialization };
+    // stages of every entry point
+    VkShaderStageFlags stages = 0;
+
+    uint32_t get_set_count() const {
+        return bindings.empty() ? 0 : bindings.back().set + 1;
     }
+};
 
+// One pass over the module header and global declarations. Every id gets the
+// word offset of its defining instruction and only the decorations reflection
+// needs are kept; types are resolved afterwards by jumping back into the
+// mapped words. Function bodies, usually most of a module, are never walked:
+// the logical layout puts every global before the first OpFunction.
+class spirv_reflector {
+public:
+    explicit spirv_reflector(std::span<const uint32_t> words) : m_words{ words } {
+        if (words.size() < 5 || words[0] != spirv_file::magic_number) {
+            throw std::runtime_error{ "not a spirv module" };
+        }
+        m_definitions.assign(words[3], 0);
+    }
+
+    spirv_reflection reflect() {
+        scan();
+        std::sort(m_decorations.begin(), m_decorations.end());
+        auto reflection = spirv_reflection{};
+        reflection.stages = m_stages;
+        reflection.local_size = m_local_size;
+        for (size_t i = 0; i < 3; i++) {
+            if (m_local_size_id[i] != 0) {
+                reflection.local_size[i] = get_constant(m_local_size_id[i]);
+                reflection.local_size_ids[i] = find_decoration(m_local_size_id[i], decoration_spec_id);
+            }
+        }
+        reflect_workgroup_size_builtin(reflection);
+        for (auto variable : m_variables) {
+            reflect_variable(variable, reflection);
+        }
+        for (auto& decoration : m_decorations) {
+            if (decoration.kind == decoration_spec_id && decoration.member == no_member) {
+                reflection.specialization_constants.push_back({ decoration.value, get_spec_constant_size(decoration.target) });
+            }
+        }
+        std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](auto& a, auto& b) {
+            return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+        });
+        std::sort(reflection.specialization_constants.begin(), reflection.specialization_constants.end(),
+            [](auto& a, auto& b) { return a.id < b.id; });
+        return reflection;
+    }
 private:
-    HANDLE hFile;
-    HANDLE hMapping;
-    void* mmaped_ptr;
-};
\ No newline at end of file
+    static constexpr uint32_t no_member = UINT32_MAX;
+    static constexpr uint32_t not_found = UINT32_MAX;
+
+    enum opcode : uint32_t {
+        op_entry_point = 15,
+        op_execution_mode = 16,
+        op_type_bool = 20,
+        op_type_int = 21,
+        op_type_float = 22,
+        op_type_vector = 23,
+        op_type_matrix = 24,
+        op_type_image = 25,
+        op_type_sampler = 26,
+        op_type_sampled_image = 27,
+        op_type_array = 28,
+        op_type_runtime_array = 29,
+        op_type_struct = 30,
+        op_type_pointer = 32,
+        op_constant_true = 41,
+        op_constant_false = 42,
+        op_constant = 43,
+        op_constant_composite = 44,
+        op_spec_constant_true = 48,
+        op_spec_constant_false = 49,
+        op_spec_constant = 50,
+        op_spec_constant_composite = 51,
+        op_spec_constant_op = 52,
+        op_function = 54,
+        op_variable = 59,
+        op_decorate = 71,
+        op_member_decorate = 72,
+        op_execution_mode_id = 331,
+    };
+    enum decoration_kind : uint32_t {
+        decoration_spec_id = 1,
+        decoration_block = 2,
+        decoration_buffer_block = 3,
+        decoration_array_stride = 6,
+        decoration_matrix_stride = 7,
+        decoration_built_in = 11,
+        decoration_binding = 33,
+        decoration_descriptor_set = 34,
+        decoration_offset = 35,
+    };
+    enum storage_class : uint32_t {
+        storage_uniform_constant = 0,
+        storage_uniform = 2,
+        storage_push_constant = 9,
+        storage_storage_buffer = 12,
+        storage_physical_storage_buffer = 5349,
+    };
+    static constexpr uint32_t execution_mode_local_size = 17;
+    static constexpr uint32_t execution_mode_local_size_id = 38;
+    static constexpr uint32_t built_in_workgroup_size = 25;
+
+    struct decoration {
+        uint32_t target;
+        uint32_t member;
+        uint32_t kind;
+        uint32_t value;
+        auto operator<=>(const decoration&) const = default;
+    };
+
+    void scan() {
+        for (size_t offset = 5; offset < m_words.size();) {
+            auto word_count = m_words[offset] >> 16;
+            auto op = m_words[offset] & 0xffff;
+            if (word_count == 0 || offset + word_count > m_words.size()) {
+                throw std::runtime_error{ "malformed spirv instruction" };
+            }
+            auto operands = m_words.subspan(offset + 1, word_count - 1);
+            switch (op) {
+            case op_entry_point:
+                m_stages |= get_stage(operand(operands, 0));
+                break;
+            case op_execution_mode:
+                if (operand(operands, 1) == execution_mode_local_size) {
+                    m_local_size = { operand(operands, 2), operand(operands, 3), operand(operands, 4) };
+                }
+                break;
+            case op_execution_mode_id:
+                if (operand(operands, 1) == execution_mode_local_size_id) {
+                    m_local_size_id = { operand(operands, 2), operand(operands, 3), operand(operands, 4) };
+                }
+                break;
+            case op_decorate:
+                add_decoration(operand(operands, 0), no_member, operand(operands, 1), operands.size() > 2 ? operands[2] : 0);
+                break;
+            case op_member_decorate:
+                add_decoration(operand(operands, 0), operand(operands, 1), operand(operands, 2), operands.size() > 3 ? operands[3] : 0);
+                break;
+            case op_type_bool:
+            case op_type_int:
+            case op_type_float:
+            case op_type_vector:
+            case op_type_matrix:
+            case op_type_image:
+            case op_type_sampler:
+            case op_type_sampled_image:
+            case op_type_array:
+            case op_type_runtime_array:
+            case op_type_struct:
+            case op_type_pointer:
+                define(operand(operands, 0), offset);
+                break;
+            case op_constant_true:
+            case op_constant_false:
+            case op_constant:
+            case op_constant_composite:
+            case op_spec_constant_true:
+            case op_spec_constant_false:
+            case op_spec_constant:
+            case op_spec_constant_composite:
+            case op_spec_constant_op:
+                define(operand(operands, 1), offset);
+                break;
+            case op_variable:
+                define(operand(operands, 1), offset);
+                m_variables.push_back(static_cast<uint32_t>(offset));
+                break;
+            case op_function:
+                return;
+            }
+            offset += word_count;
+        }
+    }
+
+    static uint32_t operand(std::span<const uint32_t> operands, size_t i) {
+        if (i >= operands.size()) {
+            throw std::runtime_error{ "truncated spirv instruction" };
+        }
+        return operands[i];
+    }
+    static VkShaderStageFlags get_stage(uint32_t execution_model) {
+        switch (execution_model) {
+        case 0:
+            return VK_SHADER_STAGE_VERTEX_BIT;
+        case 1:
+            return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        case 2:
+            return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        case 3:
+            return VK_SHADER_STAGE_GEOMETRY_BIT;
+        case 4:
+            return VK_SHADER_STAGE_FRAGMENT_BIT;
+        case 5:
+            return VK_SHADER_STAGE_COMPUTE_BIT;
+        default:
+            return 0;
+        }
+    }
+    void add_decoration(uint32_t target, uint32_t member, uint32_t kind, uint32_t value) {
+        switch (kind) {
+        case decoration_spec_id:
+        case decoration_block:
+        case decoration_buffer_block:
+        case decoration_array_stride:
+        case decoration_matrix_stride:
+        case decoration_built_in:
+        case decoration_binding:
+        case decoration_descriptor_set:
+        case decoration_offset:
+            m_decorations.push_back({ target, member, kind, value });
+            break;
+        }
+    }
+    void define(uint32_t id, size_t offset) {
+        if (id >= m_definitions.size()) {
+            throw std::runtime_error{ "spirv id out of bound" };
+        }
+        m_definitions[id] = static_cast<uint32_t>(offset);
+    }
+    uint32_t find_decoration(uint32_t target, uint32_t kind, uint32_t member = no_member) const {
+        auto ite = std::lower_bound(m_decorations.begin(), m_decorations.end(), decoration{ target, member, kind, 0 });
+        if (ite != m_decorations.end() && ite->target == target && ite->member == member && ite->kind == kind) {
+            return ite->value;
+        }
+        return not_found;
+    }
+    bool has_decoration(uint32_t target, uint32_t kind) const {
+        return find_decoration(target, kind) != not_found;
+    }
+    // the defining instruction of id, its opcode first
+    std::span<const uint32_t> get_definition(uint32_t id) const {
+        if (id >= m_definitions.size() || m_definitions[id] == 0) {
+            throw std::runtime_error{ "undefined spirv id" };
+        }
+        auto offset = m_definitions[id];
+        return m_words.subspan(offset, m_words[offset] >> 16);
+    }
+    uint32_t get_opcode(uint32_t id) const {
+        return get_definition(id)[0] & 0xffff;
+    }
+    // value of a 32 bit constant, or the default of a specialization constant
+    // or of an integer expression of them
+    uint32_t get_constant(uint32_t id) const {
+        auto definition = get_definition(id);
+        switch (definition[0] & 0xffff) {
+        case op_spec_constant_op:
+            return evaluate_spec_constant_op(definition);
+        case op_constant:
+        case op_spec_constant:
+            return operand(definition, 3);
+        case op_constant_true:
+        case op_spec_constant_true:
+            return 1;
+        case op_constant_false:
+        case op_spec_constant_false:
+            return 0;
+        default:
+            throw std::runtime_error{ "spirv constant is not a scalar" };
+        }
+    }
+    // OpSpecConstantOp over the defaults of its operands, for the 32 bit
+    // integer operations array lengths are usually made of
+    uint32_t evaluate_spec_constant_op(std::span<const uint32_t> definition) const {
+        enum : uint32_t {
+            op_s_negate = 126,
+            op_i_add = 128,
+            op_i_sub = 130,
+            op_i_mul = 132,
+            op_u_div = 134,
+            op_s_div = 135,
+            op_u_mod = 137,
+            op_select = 169,
+            op_shift_right_logical = 194,
+            op_shift_left_logical = 196,
+            op_bitwise_or = 197,
+            op_bitwise_xor = 198,
+            op_bitwise_and = 199,
+            op_not = 200,
+        };
+        auto value = [&](size_t i) { return get_constant(operand(definition, 4 + i)); };
+        switch (operand(definition, 3)) {
+        case op_s_negate:
+            return 0u - value(0);
+        case op_i_add:
+            return value(0) + value(1);
+        case op_i_sub:
+            return value(0) - value(1);
+        case op_i_mul:
+            return value(0) * value(1);
+        case op_u_div:
+        case op_u_mod: {
+            auto divisor = value(1);
+            if (divisor == 0) {
+                throw std::runtime_error{ "spirv specialization constant divided by zero" };
+            }
+            return operand(definition, 3) == op_u_div ? value(0) / divisor : value(0) % divisor;
+        }
+        case op_s_div: {
+            auto divisor = static_cast<int32_t>(value(1));
+            if (divisor == 0) {
+                throw std::runtime_error{ "spirv specialization constant divided by zero" };
+            }
+            auto dividend = static_cast<int32_t>(value(0));
+            if (dividend == INT32_MIN && divisor == -1) {
+                return value(0);
+            }
+            return static_cast<uint32_t>(dividend / divisor);
+        }
+        case op_select:
+            return value(0) != 0 ? value(1) : value(2);
+        case op_shift_right_logical:
+            return value(1) < 32 ? value(0) >> value(1) : 0;
+        case op_shift_left_logical:
+            return value(1) < 32 ? value(0) << value(1) : 0;
+        case op_bitwise_or:
+            return value(0) | value(1);
+        case op_bitwise_xor:
+            return value(0) ^ value(1);
+        case op_bitwise_and:
+            return value(0) & value(1);
+        case op_not:
+            return ~value(0);
+        default:
+            throw std::runtime_error{ "unsupported spirv specialization constant operation" };
+        }
+    }
+    uint32_t get_spec_constant_size(uint32_t id) const {
+        auto definition = get_definition(id);
+        auto op = definition[0] & 0xffff;
+        if (op != op_spec_constant) {
+            return sizeof(VkBool32);
+        }
+        return get_type_size(operand(definition, 1));
+    }
+    // glslang's local_size_x_id: a WorkgroupSize builtin composite of spec constants
+    void reflect_workgroup_size_builtin(spirv_reflection& reflection) const {
+        for (auto& decoration : m_decorations) {
+            if (decoration.kind != decoration_built_in || decoration.value != built_in_workgroup_size ||
+                decoration.member != no_member) {
+                continue;
+            }
+            auto definition = get_definition(decoration.target);
+            auto op = definition[0] & 0xffff;
+            if (op != op_constant_composite && op != op_spec_constant_composite) {
+                continue;
+            }
+            for (size_t i = 0; i < 3; i++) {
+                auto component = operand(definition, 3 + i);
+                reflection.local_size[i] = get_constant(component);
+                reflection.local_size_ids[i] = find_decoration(component, decoration_spec_id);
+            }
+        }
+    }
+    // std140/std430 size from the offset and stride decorations
+    uint32_t get_type_size(uint32_t type, uint32_t matrix_stride = 0) const {
+        auto definition = get_definition(type);
+        switch (definition[0] & 0xffff) {
+        case op_type_bool:
+            return sizeof(VkBool32);
+        case op_type_int:
+        case op_type_float:
+            return operand(definition, 2) / 8;
+        case op_type_vector:
+            return operand(definition, 3) * get_type_size(operand(definition, 2));
+        case op_type_matrix: {
+            auto column_count = operand(definition, 3);
+            return column_count * (matrix_stride != 0 ? matrix_stride : get_type_size(operand(definition, 2)));
+        }
+        case op_type_array: {
+            auto length = get_constant(operand(definition, 3));
+            auto stride = find_decoration(type, decoration_array_stride);
+            return length * (stride != not_found ? stride : get_type_size(operand(definition, 2)));
+        }
+        case op_type_pointer:
+            // buffer references are 64 bit device addresses
+            return operand(definition, 2) == storage_physical_storage_buffer ? sizeof(uint64_t) : 0;
+        case op_type_struct: {
+            uint32_t size = 0;
+            for (uint32_t m = 0; m + 2 < definition.size(); m++) {
+                auto offset = find_decoration(type, decoration_offset, m);
+                auto stride = find_decoration(type, decoration_matrix_stride, m);
+                auto member_size = get_type_size(definition[2 + m], stride != not_found ? stride : 0);
+                size = std::max(size, (offset != not_found ? offset : size) + member_size);
+            }
+            return size;
+        }
+        default:
+            return 0;
+        }
+    }
+    uint32_t get_struct_first_offset(uint32_t type) const {
+        auto definition = get_definition(type);
+        uint32_t first = UINT32_MAX;
+        for (uint32_t m = 0; m + 2 < definition.size(); m++) {
+            auto offset = find_decoration(type, decoration_offset, m);
+            first = std::min(first, offset != not_found ? offset : 0);
+        }
+        return first == UINT32_MAX ? 0 : first;
+    }
+    void reflect_variable(uint32_t offset, spirv_reflection& reflection) const {
+        auto definition = m_words.subspan(offset, m_words[offset] >> 16);
+        auto id = operand(definition, 2);
+        auto storage = operand(definition, 3);
+        auto pointer = get_definition(operand(definition, 1));
+        auto type = operand(pointer, 3);
+        if (storage == storage_push_constant) {
+            auto first = get_struct_first_offset(type);
+            reflection.push_constant_offset = first;
+            reflection.push_constant_size = get_type_size(type) - first;
+            return;
+        }
+        if (storage != storage_uniform_constant && storage != storage_uniform && storage != storage_storage_buffer) {
+            return;
+        }
+        auto binding = spirv_reflection::descriptor_binding{};
+        binding.set = find_decoration(id, decoration_descriptor_set);
+        binding.binding = find_decoration(id, decoration_binding);
+        if (binding.set == not_found) {
+            binding.set = 0;
+        }
+        if (binding.binding == not_found) {
+            return;
+        }
+        binding.count = 1;
+        auto op = get_opcode(type);
+        if (op == op_type_array) {
+            binding.count = get_constant(operand(get_definition(type), 3));
+            type = operand(get_definition(type), 2);
+        }
+        else if (op == op_type_runtime_array) {
+            binding.count = 0;
+            type = operand(get_definition(type), 2);
+        }
+        binding.type = get_descriptor_type(storage, type);
+        reflection.bindings.push_back(binding);
+    }
+    VkDescriptorType get_descriptor_type(uint32_t storage, uint32_t type) const {
+        if (storage == storage_storage_buffer) {
+            return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        }
+        if (storage == storage_uniform) {
+            return has_decoration(type, decoration_buffer_block) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        }
+        auto definition = get_definition(type);
+        switch (definition[0] & 0xffff) {
+        case op_type_sampler:
+            return VK_DESCRIPTOR_TYPE_SAMPLER;
+        case op_type_sampled_image:
+            return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        case op_type_image: {
+            constexpr uint32_t dim_buffer = 5;
+            constexpr uint32_t dim_subpass_data = 6;
+            auto dim = operand(definition, 3);
+            bool storage_image = operand(definition, 7) == 2;
+            if (dim == dim_buffer) {
+                return storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            }
+            if (dim == dim_subpass_data) {
+                return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            }
+            return storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        }
+        default:
+            throw std::runtime_error{ "unsupported spirv resource type" };
+        }
+    }
+
+    std::span<const uint32_t> m_words;
+    // word offset of each id's defining instruction, 0 if it has none we track
+    std::vector<uint32_t> m_definitions;
+    std::vector<decoration> m_decorations;
+    // word offsets of the global OpVariables
+    std::vector<uint32_t> m_variables;
+    VkShaderStageFlags m_stages = 0;
+    std::array<uint32_t, 3> m_local_size{ 1, 1, 1 };
+    std::array<uint32_t, 3> m_local_size_id{ 0, 0, 0 };
+};
+
+inline spirv_reflection reflect_spirv(std::span<const uint32_t> words) {
+    return spirv_reflector{ words }.reflect();
+}
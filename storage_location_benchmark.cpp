@@ -0,0 +1,90 @@
+// Compares GPU kernel time with the storage buffers in host visible memory
+// against device local memory fed through staging buffers. Times come from
+// the timestamp regions recorded by basic_compute_app. The ring runs measure
+// frames/s with several frames in flight, where device local uploads go to the
+// transfer queue and overlap the previous frame's dispatch.
+//
+// usage: storage_location_benchmark [iterations]
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <map>
+#include <string>
+#include <vulkan/vulkan.h>
+#include "compute_app.hpp"
+#include "latency_histogram.hpp"
+
+template<vulkan_helper::storage_location Location>
+class storage_location_benchmark : public basic_compute_app<Location> {
+public:
+    using parent = basic_compute_app<Location>;
+
+    void run(const char* name, uint64_t iterations) {
+        auto histograms = std::map<std::string, latency_histogram>{};
+        for (uint64_t i = 0; i < iterations; i++) {
+            parent::reset();
+            parent::submit();
+            parent::wait_for();
+            for (auto& region : parent::get_region_durations()) {
+                histograms[region.name].record(std::chrono::duration_cast<std::chrono::nanoseconds>(region.duration));
+            }
+        }
+        auto us = [](auto duration) {
+            return std::chrono::duration<double, std::micro>{ duration }.count();
+        };
+        for (auto& [region, histogram] : histograms) {
+            std::cout << std::format("{:>12} {:>8}: mean {:.2f} us, p50 {:.2f} us, p99 {:.2f} us",
+                name, region, us(histogram.mean()),
+                us(histogram.percentile(0.5)), us(histogram.percentile(0.99))) << std::endl;
+        }
+    }
+};
+
+template<vulkan_helper::storage_location Location>
+class storage_location_ring_benchmark : public ring_compute_app<Location, 3> {
+public:
+    using parent = ring_compute_app<Location, 3>;
+
+    void run(const char* name, uint64_t iterations) {
+        auto begin = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            parent::submit_frame(parent::acquire_frame());
+        }
+        for (auto in_flight = parent::get_in_flight_count(); in_flight > 0; in_flight--) {
+            while (!parent::acquire_frame().has_results) {
+            }
+        }
+        auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - begin };
+        std::cout << std::format("{:>12}     ring: {:.1f} frames/s with {} in flight, separate transfer queue: {}",
+            name, iterations / elapsed.count(), parent::frame_count,
+            parent::get_queue_topology().has_separate_transfer_queue() ? "yes" : "no") << std::endl;
+    }
+};
+
+int main(int argc, char** argv) {
+    try {
+        uint64_t iterations = argc > 1 ? std::stoull(argv[1]) : 1000;
+        {
+            storage_location_benchmark<vulkan_helper::storage_location::host_visible> benchmark;
+            benchmark.run("host_visible", iterations);
+        }
+        {
+            storage_location_benchmark<vulkan_helper::storage_location::device_local> benchmark;
+            benchmark.run("device_local", iterations);
+        }
+        {
+            storage_location_ring_benchmark<vulkan_helper::storage_location::host_visible> benchmark;
+            benchmark.run("host_visible", iterations);
+        }
+        {
+            storage_location_ring_benchmark<vulkan_helper::storage_location::device_local> benchmark;
+            benchmark.run("device_local", iterations);
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+// Measures host-side submit-to-completion latency of the compute dispatch:
+// every iteration submits the prerecorded command buffer and blocks until it
+// completed, either by resetting and waiting on the fence or by waiting on the
+// next value of the timeline semaphore.
+//
+// usage: submit_latency_benchmark [iterations] [warmup iterations] [fence|timeline]
+//
+// Runs on any Vulkan 1.3 implementation; on machines without a GPU point the
+// loader at lavapipe, e.g.
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./submit_latency_benchmark
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <string>
+#include <vulkan/vulkan.h>
+#include "compute_app.hpp"
+#include "latency_histogram.hpp"
+
+class submit_latency_benchmark : public compute_app {
+public:
+    void submit_and_wait() {
+        if (m_use_timeline) {
+            compute_app::wait_for_value(compute_app::submit_timeline(compute_app::get_command_buffer()));
+            return;
+        }
+        fence::reset();
+        compute_app::submit();
+        fence::wait_for();
+    }
+    void run(uint64_t iterations, uint64_t warmup_iterations, bool use_timeline) {
+        m_use_timeline = use_timeline;
+        for (uint64_t i = 0; i < warmup_iterations; i++) {
+            submit_and_wait();
+        }
+
+        latency_histogram histogram{};
+        auto begin = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            auto start = std::chrono::steady_clock::now();
+            submit_and_wait();
+            histogram.record(std::chrono::steady_clock::now() - start);
+        }
+        auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - begin };
+
+        auto properties = compute_app::get_properties();
+        auto us = [](auto duration) {
+            return std::chrono::duration<double, std::micro>{ duration }.count();
+        };
+        std::cout << std::format("device: {}, completion: {}", properties.deviceName, m_use_timeline ? "timeline" : "fence") << std::endl;
+        std::cout << std::format("iterations: {}, elapsed: {:.3f} s, throughput: {:.1f} submits/s",
+            histogram.count(), elapsed.count(), histogram.count() / elapsed.count()) << std::endl;
+        std::cout << std::format("latency us: min {:.2f}, mean {:.2f}, p50 {:.2f}, p90 {:.2f}, p99 {:.2f}, p99.9 {:.2f}, max {:.2f}",
+            us(histogram.min()), us(histogram.mean()),
+            us(histogram.percentile(0.5)), us(histogram.percentile(0.9)),
+            us(histogram.percentile(0.99)), us(histogram.percentile(0.999)),
+            us(histogram.max())) << std::endl;
+    }
+private:
+    bool m_use_timeline = false;
+};
+
+int main(int argc, char** argv) {
+    try {
+        uint64_t iterations = argc > 1 ? std::stoull(argv[1]) : 10000;
+        uint64_t warmup_iterations = argc > 2 ? std::stoull(argv[2]) : 100;
+        bool use_timeline = argc > 3 && std::string{ argv[3] } == "timeline";
+        submit_latency_benchmark benchmark;
+        benchmark.run(iterations, warmup_iterations, use_timeline);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
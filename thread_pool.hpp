@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed set of worker threads for data parallel host work. run() hands out
+// the parts of one job to the workers and the calling thread, and returns
+// once every part finished; only one job runs at a time.
+class thread_pool {
+public:
+    // thread_count counts the calling thread, so 1 runs everything inline
+    explicit thread_pool(size_t thread_count = std::thread::hardware_concurrency()) {
+        for (size_t i = 1; i < thread_count; i++) {
+            m_workers.emplace_back([this] { work_loop(); });
+        }
+    }
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+    ~thread_pool() {
+        {
+            std::lock_guard lock{ m_mutex };
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    size_t get_thread_count() const {
+        return m_workers.size() + 1;
+    }
+
+    // calls function(part) for every part in [0, part_count) and rethrows the
+    // first exception a part threw
+    void run(size_t part_count, const std::function<void(size_t)>& function) {
+        if (part_count == 0) {
+            return;
+        }
+        {
+            std::lock_guard lock{ m_mutex };
+            m_function = &function;
+            m_part_count = part_count;
+            m_next_part.store(0, std::memory_order_relaxed);
+            m_busy_count = m_workers.size();
+            m_generation++;
+        }
+        m_wake.notify_all();
+        run_parts();
+        std::unique_lock lock{ m_mutex };
+        m_done.wait(lock, [this] { return m_busy_count == 0; });
+        m_function = nullptr;
+        if (auto exception = std::exchange(m_exception, nullptr)) {
+            std::rethrow_exception(exception);
+        }
+    }
+private:
+    void run_parts() {
+        for (size_t part; (part = m_next_part.fetch_add(1, std::memory_order_relaxed)) < m_part_count;) {
+            try {
+                (*m_function)(part);
+            }
+            catch (...) {
+                std::lock_guard lock{ m_mutex };
+                if (!m_exception) {
+                    m_exception = std::current_exception();
+                }
+            }
+        }
+    }
+    void work_loop() {
+        uint64_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock lock{ m_mutex };
+                m_wake.wait(lock, [&] { return m_stop || m_generation != seen_generation; });
+                if (m_stop) {
+                    return;
+                }
+                seen_generation = m_generation;
+            }
+            run_parts();
+            std::lock_guard lock{ m_mutex };
+            if (--m_busy_count == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(size_t)>* m_function = nullptr;
+    size_t m_part_count = 0;
+    std::atomic<size_t> m_next_part = 0;
+    size_t m_busy_count = 0;
+    uint64_t m_generation = 0;
+    bool m_stop = false;
+    std::exception_ptr m_exception;
+};
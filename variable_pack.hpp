@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+// Host reference of variable_pack.comp: every code contributes its low width
+// bits, up to 32, right after the previous code's, as one lsb first bit
+// stream. Bits of the last byte past the stream are written as zero, like the
+// kernel clears its whole output.
+namespace variable_pack {
+    // the layout of one element in the kernel's input buffer
+    struct code {
+        uint32_t value;
+        uint32_t width;
+    };
+
+    constexpr uint32_t clamped_width(const code& code) {
+        return code.width < 32 ? code.width : 32;
+    }
+
+    inline uint64_t packed_bit_count(std::span<const code> codes) {
+        uint64_t bit_count = 0;
+        for (auto& code : codes) {
+            bit_count += clamped_width(code);
+        }
+        return bit_count;
+    }
+
+    // returns the number of bits written
+    inline uint64_t pack(std::span<const code> codes, std::span<std::byte> packed) {
+        auto bit_count = packed_bit_count(codes);
+        if (packed.size() < (bit_count + 7) / 8) {
+            throw std::runtime_error{ "variable pack destination too small" };
+        }
+        uint64_t bits = 0;
+        uint32_t pending = 0;
+        auto out = packed.data();
+        for (auto& code : codes) {
+            auto width = clamped_width(code);
+            auto value = width < 32 ? code.value & ((1u << width) - 1) : code.value;
+            bits |= uint64_t{ value } << pending;
+            pending += width;
+            for (; pending >= 8; pending -= 8, bits >>= 8) {
+                *out++ = static_cast<std::byte>(bits);
+            }
+        }
+        if (pending > 0) {
+            *out = static_cast<std::byte>(bits);
+        }
+        return bit_count;
+    }
+}
@@ -0,0 +1,91 @@
+// Packs a million variable width codes, entropy coder style with mostly short
+// widths, with the reduce, scan and scatter passes of variable_pack.comp and
+// with the variable_pack CPU reference. Reports the time of every pass and
+// checks the GPU stream and bit count against the CPU ones.
+//
+// usage: variable_pack_benchmark [iterations]
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <map>
+#include <random>
+#include <string>
+#include <vulkan/vulkan.h>
+#include "compute_app.hpp"
+#include "variable_pack.hpp"
+#include "latency_histogram.hpp"
+
+constexpr uint32_t element_count = 1u << 20;
+
+class variable_pack_benchmark : public variable_pack_engine<vulkan_helper::storage_location::host_visible, element_count> {
+public:
+    using parent = variable_pack_engine<vulkan_helper::storage_location::host_visible, element_count>;
+
+    void run(uint64_t iterations) {
+        auto sizes = parent::get_storage_buffer_sizes();
+        auto ptrs = parent::get_storage_memory_ptrs();
+        auto packed = std::span{ static_cast<std::byte*>(ptrs[0]), sizes[0] };
+        auto codes = std::span{ static_cast<variable_pack::code*>(ptrs[1]), element_count };
+        auto random = std::mt19937{ 1 };
+        auto width = std::geometric_distribution<uint32_t>{ 0.25 };
+        for (auto& code : codes) {
+            code = variable_pack::code{ static_cast<uint32_t>(random()), std::min(1 + width(random), 32u) };
+        }
+        parent::mark_host_written(codes.data(), codes.size_bytes());
+        parent::flush_host_writes();
+
+        auto histograms = std::map<std::string, latency_histogram>{};
+        for (uint64_t i = 0; i < iterations; i++) {
+            parent::wait_for_value(parent::submit_timeline(parent::get_command_buffer()));
+            for (auto& region : parent::get_region_durations()) {
+                histograms[region.name].record(std::chrono::duration_cast<std::chrono::nanoseconds>(region.duration));
+            }
+        }
+        parent::mark_host_read(packed.data(), packed.size());
+        parent::mark_host_read(ptrs[2], sizes[2]);
+        parent::invalidate_host_reads();
+
+        auto expected = std::vector<std::byte>(packed.size());
+        auto cpu_iterations = std::max<uint64_t>(iterations / 10, 1);
+        uint64_t bit_count = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < cpu_iterations; i++) {
+            bit_count = variable_pack::pack(codes, expected);
+        }
+        auto cpu_time = std::chrono::duration<double, std::nano>{ std::chrono::steady_clock::now() - begin } / cpu_iterations;
+        auto byte_count = (bit_count + 7) / 8;
+        auto mismatches = std::inner_product(expected.begin(), expected.begin() + byte_count, packed.begin(), size_t{ 0 },
+            std::plus<>{}, [](std::byte lhs, std::byte rhs) { return size_t{ lhs != rhs }; });
+
+        auto us = [](auto duration) {
+            return std::chrono::duration<double, std::micro>{ duration }.count();
+        };
+        std::cout << std::format("codes: {}, bits: {}, {:.2f} bits per code", element_count, bit_count,
+            static_cast<double>(bit_count) / element_count) << std::endl;
+        double gpu_time = 0;
+        for (auto name : parent::pass_names) {
+            auto& histogram = histograms[name];
+            gpu_time += histogram.mean().count();
+            std::cout << std::format("{:>8}: mean {:.2f} us, p50 {:.2f} us, p99 {:.2f} us",
+                name, us(histogram.mean()), us(histogram.percentile(0.5)), us(histogram.percentile(0.99))) << std::endl;
+        }
+        std::cout << std::format("gpu {:.2f} Mcodes/s, cpu {:.2f} Mcodes/s, {}",
+            element_count * 1e3 / gpu_time, element_count * 1e3 / cpu_time.count(),
+            parent::get_packed_bit_count() != bit_count ? std::format("gpu bit count {} differs", parent::get_packed_bit_count()) :
+            mismatches == 0 ? std::string{ "matches cpu reference" } : std::format("{} mismatching byte(s)", mismatches)) << std::endl;
+    }
+};
+
+int main(int argc, char** argv) {
+    try {
+        uint64_t iterations = argc > 1 ? std::stoull(argv[1]) : 100;
+        variable_pack_benchmark benchmark;
+        benchmark.run(iterations);
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+// Throughput of result_verify on a passing buffer, the soak test case: the
+// scalar tier and the widest tier on one thread, and the widest tier on the
+// whole pool. A last run flips a few bits to check the report.
+//
+// usage: verify_benchmark [words] [iterations] [threads]
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <format>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pattern_fill.hpp"
+#include "result_verify.hpp"
+
+int main(int argc, char** argv) {
+    try {
+        size_t count = argc > 1 ? std::stoull(argv[1]) : size_t{ 1 } << 26;
+        uint64_t iterations = argc > 2 ? std::stoull(argv[2]) : 10;
+        size_t thread_count = argc > 3 ? std::stoull(argv[3]) : std::thread::hardware_concurrency();
+
+        thread_pool pool{ thread_count };
+        auto golden = std::vector<uint32_t>(count);
+        pattern_fill::fill(pool, { .kind = pattern_fill::pattern_kind::random, .seed = 7 }, golden);
+        auto result = golden;
+        auto best = result_verify::get_best_compare_function();
+
+        std::cout << std::format("words: {}, {} bytes per buffer, {} thread(s), best tier {}",
+            count, count * sizeof(uint32_t), pool.get_thread_count(),
+            best == result_verify::compare_scalar ? "scalar" : "avx2") << std::endl;
+        auto measure = [&](std::string_view name, auto&& compare) {
+            auto report = compare();
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; i++) {
+                report = compare();
+            }
+            auto elapsed = std::chrono::duration<double>{ std::chrono::steady_clock::now() - start };
+            // bytes of result checked, the golden words are read as well
+            std::cout << std::format("{:>16}: {:.2f} GB/s, {}", name,
+                count * sizeof(uint32_t) * iterations / elapsed.count() / 1e9,
+                result_verify::to_string(report)) << std::endl;
+        };
+        measure("scalar", [&] {
+            auto report = result_verify::report{};
+            result_verify::compare_scalar(golden.data(), result.data(), count, 0, 16, report);
+            return report;
+        });
+        measure("best tier", [&] { return result_verify::compare(golden, result); });
+        measure("best tier, pool", [&] { return result_verify::compare(pool, golden, result); });
+
+        for (size_t t : { size_t{ 0 }, count / 3, count - 1 }) {
+            if (t < count) {
+                result[t] ^= 0x80000001u;
+            }
+        }
+        std::cout << "flipped bits: " << result_verify::to_string(result_verify::compare(pool, golden, result)) << std::endl;
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -3,9 +3,23 @@
 #include <vulkan/vulkan.h>
 
 #include "spirv_helper.hpp"
+#include "memory_allocator.hpp"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <concepts>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
 #include <numeric>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace vulkan_helper {
 	class instance {
@@ -70,6 +84,27 @@ namespace vulkan_helper {
         std::unique_ptr<void> next;
     };
 
+    // How resources reach a pipeline's descriptor set, chosen per device.
+    // descriptor_set allocates and updates pool sets, push_descriptor records
+    // the writes into the command buffer (VK_KHR_push_descriptor) and
+    // descriptor_buffer writes descriptors into host visible memory the
+    // command buffer only points at (VK_EXT_descriptor_buffer).
+    enum class descriptor_mode {
+        descriptor_set,
+        push_descriptor,
+        descriptor_buffer,
+    };
+    inline const char* to_string(descriptor_mode mode) {
+        switch (mode) {
+        case descriptor_mode::push_descriptor:
+            return "push descriptor";
+        case descriptor_mode::descriptor_buffer:
+            return "descriptor buffer";
+        default:
+            return "descriptor set";
+        }
+    }
+
     class device_create_info {
     public:
         constexpr device_create_info() : m_create_info{} {
@@ -102,14 +137,119 @@ namespace vulkan_helper {
             }
         }
         void set_queue_family_index(uint32_t index) {
-            m_queue_family_index = index;
+            m_queue_families.assign(1, queue_family{ index, 1 });
+        }
+        // requests queue_count queues of the family, a family added twice keeps the larger count
+        void add_queue_family(uint32_t index, uint32_t queue_count) {
+            for (auto& family : m_queue_families) {
+                if (family.index == index) {
+                    family.queue_count = std::max(family.queue_count, queue_count);
+                    return;
+                }
+            }
+            m_queue_families.push_back(queue_family{ index, queue_count });
         }
         uint32_t get_queue_family_index() const {
-            return m_queue_family_index;
+            return m_queue_families.front().index;
+        }
+        struct queue_family {
+            uint32_t index;
+            uint32_t queue_count;
+        };
+        const auto& get_queue_families() const {
+            return m_queue_families;
+        }
+        void add_extension(const char* name) {
+            auto ite = std::find_if(m_extensions.begin(), m_extensions.end(),
+                [name](auto extension) { return std::strcmp(extension, name) == 0; });
+            if (ite == m_extensions.end()) {
+                m_extensions.push_back(name);
+            }
+        }
+        const auto& get_extensions() const {
+            return m_extensions;
+        }
+        // buffers with storage usage can be addressed, see device::get_buffer_device_address
+        void enable_buffer_device_address() {
+            m_buffer_device_address = true;
+        }
+        bool is_buffer_device_address_enabled() const {
+            return m_buffer_device_address;
+        }
+        // adds what the mode needs, see physical_device::choose_descriptor_mode
+        void set_descriptor_mode(descriptor_mode mode) {
+            m_descriptor_mode = mode;
+            if (mode == descriptor_mode::push_descriptor) {
+                add_extension(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+            }
+            else if (mode == descriptor_mode::descriptor_buffer) {
+                add_extension(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+                enable_buffer_device_address();
+            }
+        }
+        descriptor_mode get_descriptor_mode() const {
+            return m_descriptor_mode;
         }
     private:
         VkDeviceCreateInfo m_create_info;
-        int m_queue_family_index;
+        std::vector<queue_family> m_queue_families;
+        std::vector<const char*> m_extensions;
+        bool m_buffer_device_address = false;
+        descriptor_mode m_descriptor_mode = descriptor_mode::descriptor_set;
+    };
+
+    // Which families the compute and transfer work go to. The transfer family is
+    // a dedicated transfer only family if there is one, else an async compute
+    // family without graphics, else a second queue of the compute family, and
+    // only as a last resort the compute queue itself.
+    struct queue_topology {
+        uint32_t compute_family;
+        uint32_t transfer_family;
+        uint32_t transfer_queue_index;
+
+        bool has_separate_transfer_queue() const {
+            return transfer_family != compute_family || transfer_queue_index != 0;
+        }
+        bool needs_ownership_transfer() const {
+            return transfer_family != compute_family;
+        }
+    };
+    // how the subgroups of a compute pipeline are sized. required_size 0 leaves
+    // the size to the implementation. full_subgroups fills every subgroup of a
+    // workgroup, which needs the workgroup's x size to be a multiple of
+    // required_size, or of max_size without one.
+    struct subgroup_size_control {
+        uint32_t required_size = 0;
+        bool full_subgroups = false;
+    };
+
+    // what the device offers compute shaders at subgroup level, from the 1.1
+    // and 1.3 property blocks
+    struct subgroup_properties {
+        uint32_t size;
+        VkShaderStageFlags supported_stages;
+        VkSubgroupFeatureFlags supported_operations;
+        uint32_t min_size;
+        uint32_t max_size;
+        VkShaderStageFlags required_size_stages;
+
+        bool supports(VkSubgroupFeatureFlags operations) const {
+            return (supported_stages & VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+                (supported_operations & operations) == operations;
+        }
+        // preferred clamped to what can be required of a compute shader, 0 if
+        // the size can't be required there and is up to the implementation
+        uint32_t choose_required_size(uint32_t preferred) const {
+            if ((required_size_stages & VK_SHADER_STAGE_COMPUTE_BIT) == 0) {
+                return 0;
+            }
+            return std::clamp(preferred, min_size, max_size);
+        }
+        // full subgroups whatever the required size; computeFullSubgroups
+        // comes with subgroupSizeControl on every 1.3 device and is enabled
+        subgroup_size_control choose_size_control(uint32_t preferred) const {
+            return { choose_required_size(preferred), true };
+        }
     };
     class physical_device : public instance{
     public:
@@ -129,6 +269,52 @@ namespace vulkan_helper {
             }
             throw std::runtime_error{ "failed to find queue family" };
         }
+        auto get_queue_families() {
+            uint32_t count = 0;
+            vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &count, nullptr);
+            auto properties = std::vector<VkQueueFamilyProperties>(count);
+            vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &count, properties.data());
+            properties.resize(count);
+            return properties;
+        }
+        queue_topology find_queue_topology() {
+            auto families = get_queue_families();
+            auto find_family = [&families](VkQueueFlags required, VkQueueFlags excluded, uint32_t skip) -> std::optional<uint32_t> {
+                for (uint32_t i = 0; i < families.size(); i++) {
+                    auto flags = families[i].queueFlags;
+                    if (i != skip && families[i].queueCount > 0 && (flags & required) == required && (flags & excluded) == 0) {
+                        return i;
+                    }
+                }
+                return std::nullopt;
+            };
+            auto compute_family = find_family(VK_QUEUE_COMPUTE_BIT, 0, UINT32_MAX);
+            if (!compute_family) {
+                throw std::runtime_error{ "failed to find queue family" };
+            }
+            auto topology = queue_topology{ *compute_family, *compute_family, 0 };
+            // compute and graphics families support transfer even without reporting it
+            if (auto family = find_family(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, *compute_family)) {
+                topology.transfer_family = *family;
+            }
+            else if (auto family = find_family(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT, *compute_family)) {
+                topology.transfer_family = *family;
+            }
+            else if (families[*compute_family].queueCount > 1) {
+                topology.transfer_queue_index = 1;
+            }
+            return topology;
+        }
+        auto get_queue_family_properties(uint32_t queue_family_index) {
+            constexpr uint32_t COUNT = 8;
+            std::array<VkQueueFamilyProperties, COUNT> properties{};
+            uint32_t count = COUNT;
+            vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &count, properties.data());
+            if (queue_family_index >= count) {
+                throw std::runtime_error{ "queue family index out of range" };
+            }
+            return properties[queue_family_index];
+        }
         auto get_physical_device_memory_properties() {
             VkPhysicalDeviceMemoryProperties properties;
             vkGetPhysicalDeviceMemoryProperties(m_physical_device, &properties);
@@ -137,18 +323,125 @@ namespace vulkan_helper {
         auto get_memory_properties() {
             return get_physical_device_memory_properties();
         }
+        auto get_properties() {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(m_physical_device, &properties);
+            return properties;
+        }
+        subgroup_properties get_subgroup_properties() {
+            VkPhysicalDeviceVulkan13Properties vulkan_1_3_properties{};
+            vulkan_1_3_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_PROPERTIES;
+            VkPhysicalDeviceVulkan11Properties vulkan_1_1_properties{};
+            vulkan_1_1_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES;
+            vulkan_1_1_properties.pNext = &vulkan_1_3_properties;
+            VkPhysicalDeviceProperties2 properties2{};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &vulkan_1_1_properties;
+            vkGetPhysicalDeviceProperties2(m_physical_device, &properties2);
+            return subgroup_properties{
+                vulkan_1_1_properties.subgroupSize,
+                vulkan_1_1_properties.subgroupSupportedStages,
+                vulkan_1_1_properties.subgroupSupportedOperations,
+                vulkan_1_3_properties.minSubgroupSize,
+                vulkan_1_3_properties.maxSubgroupSize,
+                vulkan_1_3_properties.requiredSubgroupSizeStages,
+            };
+        }
+        auto get_extension_properties() {
+            uint32_t count = 0;
+            vkEnumerateDeviceExtensionProperties(m_physical_device, nullptr, &count, nullptr);
+            auto properties = std::vector<VkExtensionProperties>(count);
+            auto res = vkEnumerateDeviceExtensionProperties(m_physical_device, nullptr, &count, properties.data());
+            if (res != VK_SUCCESS && res != VK_INCOMPLETE) {
+                throw std::runtime_error{ "failed to enumerate device extensions" };
+            }
+            properties.resize(count);
+            return properties;
+        }
+        bool supports_extension(const char* name) {
+            auto properties = get_extension_properties();
+            return std::any_of(properties.begin(), properties.end(),
+                [name](auto& property) { return std::strcmp(property.extensionName, name) == 0; });
+        }
+        bool supports_descriptor_mode(descriptor_mode mode) {
+            switch (mode) {
+            case descriptor_mode::push_descriptor:
+                return supports_extension(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+            case descriptor_mode::descriptor_buffer: {
+                if (!supports_extension(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+                    return false;
+                }
+                VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features{};
+                descriptor_buffer_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+                VkPhysicalDeviceVulkan12Features vulkan_1_2_features{};
+                vulkan_1_2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+                vulkan_1_2_features.pNext = &descriptor_buffer_features;
+                VkPhysicalDeviceFeatures2 features2{};
+                features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+                features2.pNext = &vulkan_1_2_features;
+                vkGetPhysicalDeviceFeatures2(m_physical_device, &features2);
+                return descriptor_buffer_features.descriptorBuffer && vulkan_1_2_features.bufferDeviceAddress;
+            }
+            default:
+                return true;
+            }
+        }
+        // preferred if the device supports it, else the next mode down from
+        // descriptor_buffer over push_descriptor to descriptor_set
+        descriptor_mode choose_descriptor_mode(descriptor_mode preferred) {
+            if (preferred == descriptor_mode::descriptor_buffer && !supports_descriptor_mode(preferred)) {
+                preferred = descriptor_mode::push_descriptor;
+            }
+            if (preferred == descriptor_mode::push_descriptor && !supports_descriptor_mode(preferred)) {
+                preferred = descriptor_mode::descriptor_set;
+            }
+            return preferred;
+        }
+        auto get_descriptor_buffer_properties() {
+            VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptor_buffer_properties{};
+            descriptor_buffer_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+            VkPhysicalDeviceProperties2 properties2{};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &descriptor_buffer_properties;
+            vkGetPhysicalDeviceProperties2(m_physical_device, &properties2);
+            return descriptor_buffer_properties;
+        }
         auto create_device(const device_create_info& info) {
-            VkDeviceQueueCreateInfo queue_create_info{};
-            queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            queue_create_info.queueFamilyIndex = info.get_queue_family_index();
-            queue_create_info.queueCount = 1;
-            float priority = 1.0;
-            queue_create_info.pQueuePriorities = &priority;
+            auto& queue_families = info.get_queue_families();
+            uint32_t max_queue_count = 0;
+            for (auto& family : queue_families) {
+                max_queue_count = std::max(max_queue_count, family.queue_count);
+            }
+            auto priorities = std::vector<float>(max_queue_count, 1.0f);
+            auto queue_create_infos = std::vector<VkDeviceQueueCreateInfo>(queue_families.size());
+            for (size_t i = 0; i < queue_families.size(); i++) {
+                auto& queue_create_info = queue_create_infos[i];
+                queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+                queue_create_info.queueFamilyIndex = queue_families[i].index;
+                queue_create_info.queueCount = queue_families[i].queue_count;
+                queue_create_info.pQueuePriorities = priorities.data();
+            }
+
+            VkPhysicalDeviceVulkan12Features vulkan_1_2_features{};
+            vulkan_1_2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            vulkan_1_2_features.timelineSemaphore = VK_TRUE;
+            vulkan_1_2_features.bufferDeviceAddress = info.is_buffer_device_address_enabled();
+
+            VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features{};
+            descriptor_buffer_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+            descriptor_buffer_features.descriptorBuffer = VK_TRUE;
+            if (info.get_descriptor_mode() == descriptor_mode::descriptor_buffer) {
+                vulkan_1_2_features.pNext = &descriptor_buffer_features;
+            }
 
             VkPhysicalDeviceVulkan13Features vulkan_1_3_features{};
             vulkan_1_3_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+            vulkan_1_3_features.pNext = &vulkan_1_2_features;
             vulkan_1_3_features.synchronization2 = VK_TRUE;
             vulkan_1_3_features.maintenance4 = VK_TRUE;
+            // both are required of every 1.3 device
+            vulkan_1_3_features.subgroupSizeControl = VK_TRUE;
+            vulkan_1_3_features.computeFullSubgroups = VK_TRUE;
 
             VkPhysicalDeviceFeatures2 features2{};
             features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
@@ -157,8 +450,10 @@ namespace vulkan_helper {
             VkDeviceCreateInfo create_info{};
             create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
             create_info.pNext = &features2;
-            create_info.queueCreateInfoCount = 1;
-            create_info.pQueueCreateInfos = &queue_create_info;
+            create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
+            create_info.pQueueCreateInfos = queue_create_infos.data();
+            create_info.enabledExtensionCount = static_cast<uint32_t>(info.get_extensions().size());
+            create_info.ppEnabledExtensionNames = info.get_extensions().data();
 
             VkDevice device;
             auto res = vkCreateDevice(m_physical_device, &create_info, NULL, &device);
@@ -179,12 +474,25 @@ namespace vulkan_helper {
         VkPhysicalDevice m_physical_device;
     };
 
+    // entry points of the descriptor mode extensions, null unless the
+    // device was created with the extension
+    struct descriptor_functions {
+        PFN_vkCmdPushDescriptorSetKHR cmd_push_descriptor_set = nullptr;
+        PFN_vkGetDescriptorSetLayoutSizeEXT get_descriptor_set_layout_size = nullptr;
+        PFN_vkGetDescriptorSetLayoutBindingOffsetEXT get_descriptor_set_layout_binding_offset = nullptr;
+        PFN_vkGetDescriptorEXT get_descriptor = nullptr;
+        PFN_vkCmdBindDescriptorBuffersEXT cmd_bind_descriptor_buffers = nullptr;
+        PFN_vkCmdSetDescriptorBufferOffsetsEXT cmd_set_descriptor_buffer_offsets = nullptr;
+    };
+
     template<std::derived_from<physical_device> PD = physical_device>
     class device : public PD {
     public:
         device(std::invocable<PD&> auto&& gen_info)
             :
-            m_device{ PD::create_device(gen_info(*this)) }
+            m_create_info{ gen_info(*this) },
+            m_device{ PD::create_device(m_create_info) },
+            m_descriptor_functions{ load_descriptor_functions() }
         {}
         device() = delete;
         device(const device& device) = delete;
@@ -200,12 +508,13 @@ namespace vulkan_helper {
             vkGetDeviceQueue(m_device, queue_family_index, queue_index, &queue);
             return queue;
         }
-        VkFence create_fence() {
+        VkFence create_fence(VkFenceCreateFlags flags = 0) {
             VkFenceCreateInfo fence_create_info{};
             VkFence fence;
             {
                 auto& info = fence_create_info;
                 info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+                info.flags = flags;
                 auto res = vkCreateFence(m_device, &fence_create_info, NULL, &fence);
                 if (res != VK_SUCCESS) {
                     throw std::runtime_error{ "failed to create fence" };
@@ -217,10 +526,13 @@ namespace vulkan_helper {
             vkDestroyFence(m_device, fence, nullptr);
         }
         VkShaderModule create_shader_module(const spirv_file& file) {
+            return create_shader_module(file.words());
+        }
+        VkShaderModule create_shader_module(std::span<const uint32_t> code) {
             VkShaderModuleCreateInfo create_info{};
             create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-            create_info.codeSize = file.size();
-            create_info.pCode = file.data();
+            create_info.codeSize = code.size_bytes();
+            create_info.pCode = code.data();
             VkShaderModule shader_module;
             auto res = vkCreateShaderModule(m_device, &create_info, NULL, &shader_module);
             if (res != VK_SUCCESS) {
@@ -233,27 +545,27 @@ namespace vulkan_helper {
             vkDestroyShaderModule(m_device, shader_module, nullptr);
         }
 
-        auto create_descriptor_set_layout() {
-            auto bindings = std::vector<VkDescriptorSetLayoutBinding>(2);
-            auto indices = std::vector<uint32_t>(bindings.size());
-            std::iota(indices.begin(), indices.end(), 0);
-            std::transform(
-                indices.begin(),
-                indices.end(),
-                bindings.begin(),
-                [](auto i) {
-                    VkDescriptorSetLayoutBinding binding{};
-                    binding.binding = i;
-                    binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-                    binding.descriptorCount = 1;
-                    binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-                    return binding;
-                }
-            );
+        descriptor_mode get_descriptor_mode() const {
+            return m_create_info.get_descriptor_mode();
+        }
+        bool is_buffer_device_address_enabled() const {
+            return m_create_info.is_buffer_device_address_enabled();
+        }
+        const descriptor_functions& get_descriptor_functions() const {
+            return m_descriptor_functions;
+        }
 
+        auto create_descriptor_set_layout(std::span<const VkDescriptorSetLayoutBinding> bindings) {
             VkDescriptorSetLayoutCreateInfo create_info{};
             create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-            create_info.bindingCount = bindings.size();
+            // layouts follow the device's descriptor mode
+            if (get_descriptor_mode() == descriptor_mode::push_descriptor) {
+                create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+            }
+            else if (get_descriptor_mode() == descriptor_mode::descriptor_buffer) {
+                create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+            }
+            create_info.bindingCount = static_cast<uint32_t>(bindings.size());
             create_info.pBindings = bindings.data();
 
             VkDescriptorSetLayout descriptor_set_layout;
@@ -266,13 +578,45 @@ namespace vulkan_helper {
         void destroy_descriptor_set_layout(VkDescriptorSetLayout layout) {
             vkDestroyDescriptorSetLayout(m_device, layout, NULL);
         }
+        // descriptor_buffer mode only, the bytes a set of the layout takes in a
+        // descriptor buffer and where binding starts in them
+        VkDeviceSize get_descriptor_set_layout_size(VkDescriptorSetLayout layout) {
+            VkDeviceSize size = 0;
+            get_descriptor_buffer_function(m_descriptor_functions.get_descriptor_set_layout_size)(m_device, layout, &size);
+            return size;
+        }
+        VkDeviceSize get_descriptor_set_layout_binding_offset(VkDescriptorSetLayout layout, uint32_t binding) {
+            VkDeviceSize offset = 0;
+            get_descriptor_buffer_function(m_descriptor_functions.get_descriptor_set_layout_binding_offset)(m_device, layout, binding, &offset);
+            return offset;
+        }
+        // writes the storage buffer descriptor of size bytes at address to descriptor
+        void get_storage_buffer_descriptor(VkDeviceAddress address, VkDeviceSize range, void* descriptor, size_t size) {
+            VkDescriptorAddressInfoEXT address_info{};
+            address_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+            address_info.address = address;
+            address_info.range = range;
+            VkDescriptorGetInfoEXT info{};
+            info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+            info.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            info.data.pStorageBuffer = &address_info;
+            get_descriptor_buffer_function(m_descriptor_functions.get_descriptor)(m_device, &info, size, descriptor);
+        }
 
         auto create_pipeline_layout(VkDescriptorSetLayout descriptor_set_layout) {
+            return create_pipeline_layout(descriptor_set_layout, {});
+        }
+        auto create_pipeline_layout(VkDescriptorSetLayout descriptor_set_layout, std::span<const VkPushConstantRange> push_constant_ranges) {
+            return create_pipeline_layout(std::span<const VkDescriptorSetLayout>{ &descriptor_set_layout, 1 }, push_constant_ranges);
+        }
+        auto create_pipeline_layout(std::span<const VkDescriptorSetLayout> descriptor_set_layouts, std::span<const VkPushConstantRange> push_constant_ranges) {
             VkPipelineLayoutCreateInfo create_info{};
             create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
             create_info.flags = 0;
-            create_info.setLayoutCount = 1;
-            create_info.pSetLayouts = &descriptor_set_layout;
+            create_info.setLayoutCount = static_cast<uint32_t>(descriptor_set_layouts.size());
+            create_info.pSetLayouts = descriptor_set_layouts.data();
+            create_info.pushConstantRangeCount = static_cast<uint32_t>(push_constant_ranges.size());
+            create_info.pPushConstantRanges = push_constant_ranges.data();
             VkPipelineLayout pipeline_layout;
             auto res = vkCreatePipelineLayout(m_device, &create_info, NULL, &pipeline_layout);
             if (res != VK_SUCCESS) {
@@ -284,17 +628,36 @@ namespace vulkan_helper {
             vkDestroyPipelineLayout(m_device, pipeline_layout, NULL);
         }
         auto create_pipeline(VkShaderModule shader_module, VkPipelineLayout pipeline_layout) {
+            return create_pipeline(shader_module, pipeline_layout, VK_NULL_HANDLE);
+        }
+        auto create_pipeline(VkShaderModule shader_module, VkPipelineLayout pipeline_layout, VkPipelineCache pipeline_cache) {
+            return create_pipeline(shader_module, pipeline_layout, pipeline_cache, {});
+        }
+        auto create_pipeline(VkShaderModule shader_module, VkPipelineLayout pipeline_layout, VkPipelineCache pipeline_cache, subgroup_size_control subgroup_size,
+            const VkSpecializationInfo* specialization_info = nullptr) {
+            VkPipelineShaderStageRequiredSubgroupSizeCreateInfo subgroup_size_info{};
+            subgroup_size_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO;
+            subgroup_size_info.requiredSubgroupSize = subgroup_size.required_size;
+
             VkComputePipelineCreateInfo create_info{};
             create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-            create_info.flags = 0;
+            create_info.flags = get_descriptor_mode() == descriptor_mode::descriptor_buffer ?
+                VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
             create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            if (subgroup_size.required_size != 0) {
+                create_info.stage.pNext = &subgroup_size_info;
+            }
+            if (subgroup_size.full_subgroups) {
+                create_info.stage.flags = VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT;
+            }
             create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
             create_info.stage.module = shader_module;
             create_info.stage.pName = "main";
+            create_info.stage.pSpecializationInfo = specialization_info;
             create_info.layout = pipeline_layout;
 
             VkPipeline pipeline;
-            auto res = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &create_info, NULL, &pipeline);
+            auto res = vkCreateComputePipelines(m_device, pipeline_cache, 1, &create_info, NULL, &pipeline);
             if (res != VK_SUCCESS) {
                 throw std::runtime_error{ "failed to create compute pipeline" };
             }
@@ -304,6 +667,36 @@ namespace vulkan_helper {
             vkDestroyPipeline(m_device, pipeline, NULL);
         }
 
+        auto create_pipeline_cache(std::span<const std::byte> initial_data) {
+            VkPipelineCacheCreateInfo create_info{};
+            create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+            create_info.initialDataSize = initial_data.size();
+            create_info.pInitialData = initial_data.data();
+            VkPipelineCache pipeline_cache;
+            auto res = vkCreatePipelineCache(m_device, &create_info, NULL, &pipeline_cache);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to create pipeline cache" };
+            }
+            return pipeline_cache;
+        }
+        void destroy_pipeline_cache(VkPipelineCache pipeline_cache) {
+            vkDestroyPipelineCache(m_device, pipeline_cache, NULL);
+        }
+        auto get_pipeline_cache_data(VkPipelineCache pipeline_cache) {
+            size_t size = 0;
+            auto res = vkGetPipelineCacheData(m_device, pipeline_cache, &size, NULL);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to get pipeline cache size" };
+            }
+            auto data = std::vector<std::byte>(size);
+            res = vkGetPipelineCacheData(m_device, pipeline_cache, &size, data.data());
+            if (res != VK_SUCCESS && res != VK_INCOMPLETE) {
+                throw std::runtime_error{ "failed to get pipeline cache data" };
+            }
+            data.resize(size);
+            return data;
+        }
+
         auto create_command_pool(uint32_t queue_family_index) {
             VkCommandPoolCreateInfo create_info{};
             create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -315,6 +708,13 @@ namespace vulkan_helper {
             }
             return command_pool;
         }
+        // returns every command buffer of the pool to the initial state, for re-recording
+        void reset_command_pool(VkCommandPool command_pool) {
+            auto res = vkResetCommandPool(m_device, command_pool, 0);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to reset command pool" };
+            }
+        }
         void destroy_command_pool(VkCommandPool command_pool) {
             vkDestroyCommandPool(m_device, command_pool, NULL);
         }
@@ -332,15 +732,32 @@ namespace vulkan_helper {
             }
             return command_buffer;
         }
+        void free_command_buffer(VkCommandPool command_pool, VkCommandBuffer command_buffer) {
+            vkFreeCommandBuffers(m_device, command_pool, 1, &command_buffer);
+        }
 
         VkBuffer create_buffer(uint32_t queue_family_index, VkDeviceSize size, VkBufferUsageFlags usage) {
+            return create_buffer(std::span{ &queue_family_index, 1 }, size, usage);
+        }
+        // concurrent across the distinct families in queue_family_indices, so
+        // their queues share it without ownership transfers; exclusive for one
+        VkBuffer create_buffer(std::span<const uint32_t> queue_family_indices, VkDeviceSize size, VkBufferUsageFlags usage) {
+            auto families = std::vector<uint32_t>(queue_family_indices.begin(), queue_family_indices.end());
+            std::sort(families.begin(), families.end());
+            families.erase(std::unique(families.begin(), families.end()), families.end());
+            // with buffer device addresses every storage and descriptor buffer is addressable
+            auto addressable_usage = VkBufferUsageFlags{ VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT };
+            if (is_buffer_device_address_enabled() && (usage & addressable_usage) != 0) {
+                usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+            }
             VkBufferCreateInfo create_info{};
             create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
             create_info.size = size;
             create_info.usage = usage;
-            create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-            create_info.queueFamilyIndexCount = 1;
-            create_info.pQueueFamilyIndices = &queue_family_index;
+            create_info.sharingMode = families.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+            create_info.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+            create_info.pQueueFamilyIndices = families.data();
 
             VkBuffer buffer;
             auto res = vkCreateBuffer(m_device, &create_info, NULL, &buffer);
@@ -352,6 +769,15 @@ namespace vulkan_helper {
         void destroy_buffer(VkBuffer buffer) {
             vkDestroyBuffer(m_device, buffer, NULL);
         }
+        VkDeviceAddress get_buffer_device_address(VkBuffer buffer) {
+            if (!is_buffer_device_address_enabled()) {
+                throw std::runtime_error{ "buffer device address not enabled" };
+            }
+            VkBufferDeviceAddressInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+            info.buffer = buffer;
+            return vkGetBufferDeviceAddress(m_device, &info);
+        }
 
         uint32_t findProperties(VkPhysicalDeviceMemoryProperties memory_properties, uint32_t memoryTypeBitsRequirements, VkMemoryPropertyFlags requiredProperty) {
             const uint32_t memoryCount = memory_properties.memoryTypeCount;
@@ -368,25 +794,43 @@ namespace vulkan_helper {
             throw std::runtime_error{ "failed find memory property" };
         }
         VkDeviceMemory alloc_device_memory(VkPhysicalDeviceMemoryProperties memory_properties,  VkBuffer buffer, VkMemoryPropertyFlags property) {
-            VkMemoryRequirements requirements;
-            vkGetBufferMemoryRequirements(m_device, buffer, &requirements);
+            auto requirements = get_buffer_memory_requirements(buffer);
             uint32_t memoryType = findProperties(memory_properties, requirements.memoryTypeBits, property);
 
+            auto device_memory = allocate_memory(requirements.size, memoryType);
+            bind_buffer_memory(buffer, device_memory, 0);
+            return device_memory;
+        }
+        VkMemoryRequirements get_buffer_memory_requirements(VkBuffer buffer) {
+            VkMemoryRequirements requirements;
+            vkGetBufferMemoryRequirements(m_device, buffer, &requirements);
+            return requirements;
+        }
+        VkDeviceMemory allocate_memory(VkDeviceSize size, uint32_t memory_type_index) {
             VkDeviceMemory device_memory{};
-            {
-                VkMemoryAllocateInfo info{};
-                info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-                info.allocationSize = requirements.size;
-                info.memoryTypeIndex = memoryType;
-                auto res = vkAllocateMemory(m_device, &info, NULL, &device_memory);
-                if (res != VK_SUCCESS) {
-                    throw std::runtime_error{ "failed to allocate device memory" };
-                }
+            VkMemoryAllocateFlagsInfo flags_info{};
+            flags_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+            flags_info.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+            VkMemoryAllocateInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            // any block may end up backing an addressable buffer
+            if (is_buffer_device_address_enabled()) {
+                info.pNext = &flags_info;
+            }
+            info.allocationSize = size;
+            info.memoryTypeIndex = memory_type_index;
+            auto res = vkAllocateMemory(m_device, &info, NULL, &device_memory);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to allocate device memory" };
             }
-
-            vkBindBufferMemory(m_device, buffer, device_memory, 0);
             return device_memory;
         }
+        void bind_buffer_memory(VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset) {
+            auto res = vkBindBufferMemory(m_device, buffer, memory, offset);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to bind buffer memory" };
+            }
+        }
         void free_device_memory(VkDeviceMemory device_memory) {
             vkFreeMemory(m_device, device_memory, NULL);
         }
@@ -402,19 +846,18 @@ namespace vulkan_helper {
             vkUnmapMemory(m_device, device_memory);
         }
 
-        auto create_descriptor_pool() {
-            VkDescriptorPoolSize pool_size{};
-            pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            pool_size.descriptorCount = 2;
-
+        auto create_descriptor_pool(uint32_t max_sets, std::span<const VkDescriptorPoolSize> pool_sizes) {
             VkDescriptorPoolCreateInfo info{};
             info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-            info.maxSets = 1;
-            info.poolSizeCount = 1;
-            info.pPoolSizes = &pool_size;
+            info.maxSets = max_sets;
+            info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+            info.pPoolSizes = pool_sizes.data();
 
             VkDescriptorPool descriptor_pool;
-            vkCreateDescriptorPool(m_device, &info, NULL, &descriptor_pool);
+            auto res = vkCreateDescriptorPool(m_device, &info, NULL, &descriptor_pool);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to create descriptor pool" };
+            }
             return descriptor_pool;
         }
 
@@ -438,6 +881,56 @@ namespace vulkan_helper {
         void update_descriptor_set(const VkWriteDescriptorSet& write) {
             vkUpdateDescriptorSets(m_device, 1, &write, 0, NULL);
         }
+        // frees every set allocated from the pool
+        void reset_descriptor_pool(VkDescriptorPool descriptor_pool) {
+            auto res = vkResetDescriptorPool(m_device, descriptor_pool, 0);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to reset descriptor pool" };
+            }
+        }
+
+        auto create_query_pool(VkQueryType type, uint32_t count) {
+            VkQueryPoolCreateInfo create_info{};
+            create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            create_info.queryType = type;
+            create_info.queryCount = count;
+            VkQueryPool query_pool;
+            auto res = vkCreateQueryPool(m_device, &create_info, NULL, &query_pool);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to create query pool" };
+            }
+            return query_pool;
+        }
+        void destroy_query_pool(VkQueryPool query_pool) {
+            vkDestroyQueryPool(m_device, query_pool, NULL);
+        }
+        auto get_query_pool_results(VkQueryPool query_pool, uint32_t first_query, uint32_t query_count) {
+            auto results = std::vector<uint64_t>(query_count);
+            auto res = vkGetQueryPoolResults(m_device, query_pool, first_query, query_count,
+                results.size() * sizeof(uint64_t), results.data(), sizeof(uint64_t),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to get query pool results" };
+            }
+            return results;
+        }
+        // no wait, a query that has not been written yet comes back empty
+        auto get_available_query_pool_results(VkQueryPool query_pool, uint32_t first_query, uint32_t query_count) {
+            auto values = std::vector<uint64_t>(2 * query_count);
+            auto res = vkGetQueryPoolResults(m_device, query_pool, first_query, query_count,
+                values.size() * sizeof(uint64_t), values.data(), 2 * sizeof(uint64_t),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+            if (res != VK_SUCCESS && res != VK_NOT_READY) {
+                throw std::runtime_error{ "failed to get query pool results" };
+            }
+            auto results = std::vector<std::optional<uint64_t>>(query_count);
+            for (uint32_t i = 0; i < query_count; i++) {
+                if (values[2 * i + 1] != 0) {
+                    results[i] = values[2 * i];
+                }
+            }
+            return results;
+        }
 
         void reset_fence(VkFence fence) {
             if (VK_SUCCESS != vkResetFences(m_device, 1, &fence)) {
@@ -452,20 +945,124 @@ namespace vulkan_helper {
             }
         }
 
-        void invalidate_mapped_memory_ranges(VkDeviceMemory memory, uint32_t offset, uint32_t size) {
+        void queue_submit(VkQueue queue, std::span<const VkCommandBuffer> command_buffers,
+            std::span<const VkSemaphoreSubmitInfo> waits, std::span<const VkSemaphoreSubmitInfo> signals, VkFence fence = VK_NULL_HANDLE) {
+            auto command_buffer_infos = std::vector<VkCommandBufferSubmitInfo>(command_buffers.size());
+            for (size_t i = 0; i < command_buffers.size(); i++) {
+                auto& info = command_buffer_infos[i];
+                info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+                info.commandBuffer = command_buffers[i];
+            }
+            VkSubmitInfo2 submit_info{};
+            {
+                auto& info = submit_info;
+                info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+                info.waitSemaphoreInfoCount = static_cast<uint32_t>(waits.size());
+                info.pWaitSemaphoreInfos = waits.data();
+                info.commandBufferInfoCount = static_cast<uint32_t>(command_buffer_infos.size());
+                info.pCommandBufferInfos = command_buffer_infos.data();
+                info.signalSemaphoreInfoCount = static_cast<uint32_t>(signals.size());
+                info.pSignalSemaphoreInfos = signals.data();
+            }
+            auto res = vkQueueSubmit2(queue, 1, &submit_info, fence);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to submit queue" };
+            }
+        }
+
+        VkSemaphore create_timeline_semaphore(uint64_t initial_value) {
+            VkSemaphoreTypeCreateInfo type_create_info{};
+            type_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+            type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+            type_create_info.initialValue = initial_value;
+            VkSemaphoreCreateInfo create_info{};
+            create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            create_info.pNext = &type_create_info;
+            VkSemaphore semaphore;
+            auto res = vkCreateSemaphore(m_device, &create_info, NULL, &semaphore);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to create timeline semaphore" };
+            }
+            return semaphore;
+        }
+        void destroy_semaphore(VkSemaphore semaphore) {
+            vkDestroySemaphore(m_device, semaphore, NULL);
+        }
+        uint64_t get_semaphore_counter_value(VkSemaphore semaphore) {
+            uint64_t value;
+            auto res = vkGetSemaphoreCounterValue(m_device, semaphore, &value);
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to get semaphore counter value" };
+            }
+            return value;
+        }
+        // false if the timeout expired before the semaphore reached value
+        bool wait_for_semaphore(VkSemaphore semaphore, uint64_t value, uint64_t timeout = UINT64_MAX) {
+            VkSemaphoreWaitInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            info.semaphoreCount = 1;
+            info.pSemaphores = &semaphore;
+            info.pValues = &value;
+            auto res = vkWaitSemaphores(m_device, &info, timeout);
+            if (res == VK_TIMEOUT) {
+                return false;
+            }
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "wait semaphore fail" };
+            }
+            return true;
+        }
+
+        void invalidate_mapped_memory_ranges(VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size) {
             VkMappedMemoryRange memory_range{};
             memory_range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
             memory_range.memory = memory;
             memory_range.offset = offset;
             memory_range.size = size;
-            auto res = vkInvalidateMappedMemoryRanges(m_device, 1, &memory_range);
+            invalidate_mapped_memory_ranges({ &memory_range, 1 });
+        }
+        void invalidate_mapped_memory_ranges(std::span<const VkMappedMemoryRange> memory_ranges) {
+            auto res = vkInvalidateMappedMemoryRanges(m_device, static_cast<uint32_t>(memory_ranges.size()), memory_ranges.data());
             if (res != VK_SUCCESS) {
                 throw std::runtime_error{ "failed to invalidate mapped memory" };
             }
         }
+        void flush_mapped_memory_ranges(std::span<const VkMappedMemoryRange> memory_ranges) {
+            auto res = vkFlushMappedMemoryRanges(m_device, static_cast<uint32_t>(memory_ranges.size()), memory_ranges.data());
+            if (res != VK_SUCCESS) {
+                throw std::runtime_error{ "failed to flush mapped memory" };
+            }
+        }
 
     private:
+        descriptor_functions load_descriptor_functions() {
+            auto load = [this]<class F>(F& function, const char* name) {
+                function = reinterpret_cast<F>(vkGetDeviceProcAddr(m_device, name));
+            };
+            descriptor_functions functions{};
+            if (get_descriptor_mode() == descriptor_mode::push_descriptor) {
+                load(functions.cmd_push_descriptor_set, "vkCmdPushDescriptorSetKHR");
+            }
+            else if (get_descriptor_mode() == descriptor_mode::descriptor_buffer) {
+                load(functions.get_descriptor_set_layout_size, "vkGetDescriptorSetLayoutSizeEXT");
+                load(functions.get_descriptor_set_layout_binding_offset, "vkGetDescriptorSetLayoutBindingOffsetEXT");
+                load(functions.get_descriptor, "vkGetDescriptorEXT");
+                load(functions.cmd_bind_descriptor_buffers, "vkCmdBindDescriptorBuffersEXT");
+                load(functions.cmd_set_descriptor_buffer_offsets, "vkCmdSetDescriptorBufferOffsetsEXT");
+            }
+            return functions;
+        }
+        template<class F>
+        static F get_descriptor_buffer_function(F function) {
+            if (function == nullptr) {
+                throw std::runtime_error{ "descriptor buffer mode not enabled on this device" };
+            }
+            return function;
+        }
+
+        device_create_info m_create_info;
         VkDevice m_device;
+        descriptor_functions m_descriptor_functions;
     };
 
     template<class D>
@@ -512,12 +1109,196 @@ namespace vulkan_helper {
         VkFence m_fence;
     };
 
+    inline VkSemaphoreSubmitInfo make_semaphore_submit_info(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags2 stage) {
+        VkSemaphoreSubmitInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        info.semaphore = semaphore;
+        info.value = value;
+        info.stageMask = stage;
+        return info;
+    }
+
+    // Completion tracking with one timeline semaphore: every submission signals
+    // the next value of the counter, so the host polls or waits on a value
+    // instead of resetting and waiting on a fence, and a submission can wait on
+    // an earlier value on the device without a host round trip.
     template<class D>
-    class descriptor_set_layout : public D {
+    class timeline_semaphore : public D {
+    public:
+        timeline_semaphore() : m_semaphore{ D::create_timeline_semaphore(0) }
+        {}
+        timeline_semaphore(const timeline_semaphore&) = delete;
+        timeline_semaphore(timeline_semaphore&&) = delete;
+        ~timeline_semaphore() {
+            if (m_submitted_value > m_completed_value) {
+                D::wait_for_semaphore(m_semaphore, m_submitted_value);
+            }
+            D::destroy_semaphore(m_semaphore);
+        }
+        timeline_semaphore& operator=(const timeline_semaphore&) = delete;
+        timeline_semaphore& operator=(timeline_semaphore&&) = delete;
+
+        VkSemaphore get_timeline_semaphore() const {
+            return m_semaphore;
+        }
+        // value signaled by the most recent submission, 0 before the first one
+        uint64_t get_submitted_value() const {
+            return m_submitted_value;
+        }
+
+        // submits on D::get_queue() and returns the value signaled once the work
+        // completed; a non zero wait_value makes wait_stage wait for that value first
+        uint64_t submit_timeline(std::span<const VkCommandBuffer> command_buffers,
+            uint64_t wait_value = 0, VkPipelineStageFlags2 wait_stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) {
+            if (wait_value == 0) {
+                return submit_timeline(command_buffers, std::span<const VkSemaphoreSubmitInfo>{});
+            }
+            auto wait = make_semaphore_submit_info(m_semaphore, wait_value, wait_stage);
+            return submit_timeline(command_buffers, std::span<const VkSemaphoreSubmitInfo>{ &wait, 1 });
+        }
+        uint64_t submit_timeline(VkCommandBuffer command_buffer,
+            uint64_t wait_value = 0, VkPipelineStageFlags2 wait_stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) {
+            return submit_timeline(std::span<const VkCommandBuffer>{ &command_buffer, 1 }, wait_value, wait_stage);
+        }
+        // waits on arbitrary semaphores, e.g. the timeline of another queue
+        uint64_t submit_timeline(std::span<const VkCommandBuffer> command_buffers, std::span<const VkSemaphoreSubmitInfo> waits) {
+            auto signal = make_semaphore_submit_info(m_semaphore, m_submitted_value + 1, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+            D::queue_submit(D::get_queue(), command_buffers, waits, std::span<const VkSemaphoreSubmitInfo>{ &signal, 1 });
+            return ++m_submitted_value;
+        }
+
+        // non blocking; only asks the driver when the cached counter is behind value
+        bool is_completed(uint64_t value) {
+            if (value > m_completed_value) {
+                m_completed_value = D::get_semaphore_counter_value(m_semaphore);
+            }
+            return value <= m_completed_value;
+        }
+        void wait_for_value(uint64_t value) {
+            if (value > m_completed_value) {
+                D::wait_for_semaphore(m_semaphore, value);
+                m_completed_value = value;
+            }
+        }
+        // false if the value was not reached within timeout
+        bool wait_for_value(uint64_t value, std::chrono::nanoseconds timeout) {
+            if (value <= m_completed_value) {
+                return true;
+            }
+            if (!D::wait_for_semaphore(m_semaphore, value, static_cast<uint64_t>(timeout.count()))) {
+                return false;
+            }
+            m_completed_value = value;
+            return true;
+        }
+        void wait_idle() {
+            wait_for_value(m_submitted_value);
+        }
+    private:
+        VkSemaphore m_semaphore;
+        uint64_t m_submitted_value = 0;
+        uint64_t m_completed_value = 0;
+    };
+
+    // descriptor set 0 of a reflected module, for every stage of the module
+    inline std::vector<VkDescriptorSetLayoutBinding> get_descriptor_set_layout_bindings(const spirv_reflection& reflection) {
+        if (reflection.get_set_count() > 1) {
+            throw std::runtime_error{ "only descriptor set 0 is supported" };
+        }
+        auto bindings = std::vector<VkDescriptorSetLayoutBinding>{};
+        for (auto& resource : reflection.bindings) {
+            if (resource.count == 0) {
+                throw std::runtime_error{ "runtime sized descriptor arrays are not supported" };
+            }
+            VkDescriptorSetLayoutBinding binding{};
+            binding.binding = resource.binding;
+            binding.descriptorType = resource.type;
+            binding.descriptorCount = resource.count;
+            binding.stageFlags = reflection.stages;
+            bindings.push_back(binding);
+        }
+        return bindings;
+    }
+    // enough descriptors of every type for set_count sets of the module's set 0
+    inline std::vector<VkDescriptorPoolSize> get_descriptor_pool_sizes(const spirv_reflection& reflection, uint32_t set_count) {
+        auto pool_sizes = std::vector<VkDescriptorPoolSize>{};
+        for (auto& binding : get_descriptor_set_layout_bindings(reflection)) {
+            auto ite = std::find_if(pool_sizes.begin(), pool_sizes.end(),
+                [&](auto& pool_size) { return pool_size.type == binding.descriptorType; });
+            if (ite == pool_sizes.end()) {
+                ite = pool_sizes.insert(pool_sizes.end(), VkDescriptorPoolSize{ binding.descriptorType, 0 });
+            }
+            ite->descriptorCount += binding.descriptorCount * set_count;
+        }
+        return pool_sizes;
+    }
+    inline std::vector<VkPushConstantRange> get_push_constant_ranges(const spirv_reflection& reflection) {
+        if (reflection.push_constant_size == 0) {
+            return {};
+        }
+        VkPushConstantRange range{};
+        range.stageFlags = reflection.stages;
+        range.offset = reflection.push_constant_offset;
+        range.size = reflection.push_constant_size;
+        return { range };
+    }
+    // the interface of modules sharing one pipeline layout: every binding of
+    // either module and a push constant block covering both. Specialization
+    // constants and workgroup size stay those of first.
+    inline spirv_reflection merge_reflections(spirv_reflection first, const spirv_reflection& second) {
+        for (auto& binding : second.bindings) {
+            auto ite = std::find_if(first.bindings.begin(), first.bindings.end(),
+                [&](auto& b) { return b.set == binding.set && b.binding == binding.binding; });
+            if (ite == first.bindings.end()) {
+                first.bindings.push_back(binding);
+            }
+            else if (ite->type != binding.type) {
+                throw std::runtime_error{ "modules disagree on the type of a binding" };
+            }
+            else if (ite->count != 0) {
+                // a runtime sized array in either stays runtime sized
+                ite->count = binding.count == 0 ? 0 : std::max(ite->count, binding.count);
+            }
+        }
+        std::sort(first.bindings.begin(), first.bindings.end(), [](auto& a, auto& b) {
+            return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+        });
+        if (first.push_constant_size == 0) {
+            first.push_constant_offset = second.push_constant_offset;
+            first.push_constant_size = second.push_constant_size;
+        }
+        else if (second.push_constant_size != 0) {
+            auto begin = std::min(first.push_constant_offset, second.push_constant_offset);
+            auto end = std::max(first.push_constant_offset + first.push_constant_size,
+                second.push_constant_offset + second.push_constant_size);
+            first.push_constant_offset = begin;
+            first.push_constant_size = end - begin;
+        }
+        first.stages |= second.stages;
+        return first;
+    }
+
+    // Reflection of the module at path, or of several modules merged, which
+    // descriptor_set_layout, descriptor_pool, descriptor_binder, pipeline_layout
+    // and frame_ring build from.
+    template<class D>
+    class shader_reflection : public D {
     public:
-        descriptor_set_layout() : m_descriptor_set_layout{
-            D::create_descriptor_set_layout()
+        shader_reflection(std::filesystem::path path) : m_reflection{ reflect_spirv(spirv_file{ path }.words()) }
+        {}
+        shader_reflection(spirv_reflection reflection) : m_reflection{ std::move(reflection) }
+        {}
+        const spirv_reflection& get_shader_reflection() const {
+            return m_reflection;
         }
+    private:
+        spirv_reflection m_reflection;
+    };
+
+    template<class D>
+    class descriptor_set_layout : public D {
+    public:
+        descriptor_set_layout() : m_descriptor_set_layout{ build_descriptor_set_layout() }
         {}
         ~descriptor_set_layout() {
             D::destroy_descriptor_set_layout(m_descriptor_set_layout);
@@ -527,13 +1308,17 @@ namespace vulkan_helper {
             return m_descriptor_set_layout;
         }
     private:
+        VkDescriptorSetLayout build_descriptor_set_layout() {
+            auto bindings = get_descriptor_set_layout_bindings(D::get_shader_reflection());
+            return D::create_descriptor_set_layout(std::span<const VkDescriptorSetLayoutBinding>{ bindings });
+        }
         VkDescriptorSetLayout m_descriptor_set_layout;
     };
 
     template<class D>
     class descriptor_pool : public D {
     public:
-        descriptor_pool() : m_descriptor_pool{D::create_descriptor_pool()}
+        descriptor_pool() : m_descriptor_pool{ build_descriptor_pool() }
         {}
         ~descriptor_pool() {
             D::destroy_descriptor_pool(m_descriptor_pool);
@@ -546,6 +1331,10 @@ namespace vulkan_helper {
             return m_descriptor_pool;
         }
     private:
+        VkDescriptorPool build_descriptor_pool() {
+            auto pool_sizes = get_descriptor_pool_sizes(D::get_shader_reflection(), 1);
+            return D::create_descriptor_pool(1, std::span<const VkDescriptorPoolSize>{ pool_sizes });
+        }
         VkDescriptorPool m_descriptor_pool;
     };
 
@@ -566,7 +1355,7 @@ namespace vulkan_helper {
     template<class D>
     class pipeline_layout : public D {
     public:
-        pipeline_layout() : m_pipeline_layout{D::create_pipeline_layout(D::get_descriptor_set_layout())}
+        pipeline_layout() : m_pipeline_layout{ build_pipeline_layout() }
         {}
         ~pipeline_layout() {
             D::destroy_pipeline_layout(m_pipeline_layout);
@@ -575,6 +1364,21 @@ namespace vulkan_helper {
             return m_pipeline_layout;
         }
     private:
+        VkPipelineLayout build_pipeline_layout() {
+            auto ranges = get_push_constant_ranges(D::get_shader_reflection());
+            return create_layout(ranges);
+        }
+        // without a descriptor set layout in D the kernel has no descriptors,
+        // it reaches its buffers through device addresses
+        VkPipelineLayout create_layout(std::span<const VkPushConstantRange> ranges) {
+            if constexpr (requires(D & d) { d.get_descriptor_set_layout(); }) {
+                auto descriptor_set_layout = D::get_descriptor_set_layout();
+                return D::create_pipeline_layout(std::span<const VkDescriptorSetLayout>{ &descriptor_set_layout, 1 }, ranges);
+            }
+            else {
+                return D::create_pipeline_layout(std::span<const VkDescriptorSetLayout>{}, ranges);
+            }
+        }
         VkPipelineLayout m_pipeline_layout;
     };
 
@@ -583,6 +1387,8 @@ namespace vulkan_helper {
     public:
         shader_module(D& device, const spirv_file& file) : m_device{ device }, m_shader_module { device.create_shader_module(file) }
         {}
+        shader_module(D& device, std::span<const uint32_t> code) : m_device{ device }, m_shader_module{ device.create_shader_module(code) }
+        {}
         ~shader_module() {
             m_device.destroy_shader_module(m_shader_module);
         }
@@ -595,10 +1401,102 @@ namespace vulkan_helper {
         VkShaderModule m_shader_module;
     };
 
+    template<class D>
+    class pipeline_cache : public D {
+    public:
+        pipeline_cache(std::filesystem::path path) :
+            m_path{ std::move(path) },
+            m_pipeline_cache{ load_pipeline_cache() }
+        {}
+        pipeline_cache(const pipeline_cache&) = delete;
+        pipeline_cache(pipeline_cache&&) = delete;
+        ~pipeline_cache() {
+            try {
+                save_pipeline_cache();
+            }
+            catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+            D::destroy_pipeline_cache(m_pipeline_cache);
+        }
+        pipeline_cache& operator=(const pipeline_cache&) = delete;
+        pipeline_cache& operator=(pipeline_cache&&) = delete;
+
+        auto get_pipeline_cache() const {
+            return m_pipeline_cache;
+        }
+        // true when a blob from a previous run matched this device and was loaded
+        bool is_pipeline_cache_warm() const {
+            return m_warm;
+        }
+        void add_pipeline_creation_time(std::chrono::nanoseconds duration) {
+            m_pipeline_creation_time += duration;
+            m_pipeline_creation_count++;
+        }
+        auto get_pipeline_creation_time() const {
+            return m_pipeline_creation_time;
+        }
+        auto get_pipeline_creation_count() const {
+            return m_pipeline_creation_count;
+        }
+    private:
+        bool is_compatible(std::span<const std::byte> data) {
+            VkPipelineCacheHeaderVersionOne header{};
+            if (data.size() < sizeof(header)) {
+                return false;
+            }
+            std::memcpy(&header, data.data(), sizeof(header));
+            auto properties = D::get_properties();
+            return header.headerSize >= sizeof(header) &&
+                header.headerSize <= data.size() &&
+                header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                header.vendorID == properties.vendorID &&
+                header.deviceID == properties.deviceID &&
+                std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        }
+        VkPipelineCache load_pipeline_cache() {
+            auto ec = std::error_code{};
+            if (std::filesystem::is_regular_file(m_path, ec)) {
+                auto file = mmaped_file{ m_path };
+                if (is_compatible(file.bytes())) {
+                    m_warm = true;
+                    return D::create_pipeline_cache(file.bytes());
+                }
+            }
+            return D::create_pipeline_cache({});
+        }
+        void save_pipeline_cache() {
+            auto data = D::get_pipeline_cache_data(m_pipeline_cache);
+            auto tmp_path = m_path;
+            tmp_path += ".tmp";
+            try {
+                write_file_synced(tmp_path, data);
+                // rename replaces the old blob in one step, and the synced write
+                // means the new one is complete by then
+                std::filesystem::rename(tmp_path, m_path);
+            }
+            catch (...) {
+                auto ec = std::error_code{};
+                std::filesystem::remove(tmp_path, ec);
+                throw;
+            }
+        }
+
+        std::filesystem::path m_path;
+        bool m_warm = false;
+        VkPipelineCache m_pipeline_cache;
+        std::chrono::nanoseconds m_pipeline_creation_time{};
+        uint32_t m_pipeline_creation_count = 0;
+    };
+
     template<class D>
     class pipeline : public D {
     public:
-        pipeline(std::invocable<D&> auto&& generate_shader_module) : m_pipeline{ D::create_pipeline(generate_shader_module(*this).get_shader_module(), D::get_pipeline_layout())}
+        pipeline(std::invocable<D&> auto&& generate_shader_module) : m_pipeline{ build_pipeline(generate_shader_module(*this).get_shader_module(), {}) }
+        {}
+        // choose_subgroup_size returns the subgroup_size_control of the pipeline
+        pipeline(std::invocable<D&> auto&& generate_shader_module, std::invocable<D&> auto&& choose_subgroup_size) :
+            m_pipeline{ build_pipeline(generate_shader_module(*this).get_shader_module(), choose_subgroup_size(*this)) }
         {}
         ~pipeline() {
             D::destroy_pipeline(m_pipeline);
@@ -607,20 +1505,90 @@ namespace vulkan_helper {
             return m_pipeline;
         }
     private:
+        VkPipeline build_pipeline(VkShaderModule shader_module, subgroup_size_control subgroup_size) {
+            if constexpr (requires(D & d) { d.get_pipeline_cache(); }) {
+                auto start = std::chrono::steady_clock::now();
+                auto pipeline = D::create_pipeline(shader_module, D::get_pipeline_layout(), D::get_pipeline_cache(), subgroup_size);
+                D::add_pipeline_creation_time(std::chrono::steady_clock::now() - start);
+                return pipeline;
+            }
+            else {
+                return D::create_pipeline(shader_module, D::get_pipeline_layout(), VK_NULL_HANDLE, subgroup_size);
+            }
+        }
         VkPipeline m_pipeline;
     };
 
+    // Pipelines of one shader module, specialized on demand. A variant is keyed
+    // by its uint32_t specialization constants, constant i going to constant_id
+    // i, and built once, through the pipeline cache when D has one.
     template<class D>
-    class command_buffer : public D {
+    class pipeline_variants : public D {
     public:
-        command_buffer() : m_command_buffer{D::allocate_command_buffer(D::get_command_pool())}
+        pipeline_variants(std::invocable<D&> auto&& generate_shader_module) : m_shader_module{ generate_shader_module(*this) }
         {}
-        auto get_command_buffer() const{
-            return m_command_buffer;
+        pipeline_variants(const pipeline_variants&) = delete;
+        pipeline_variants(pipeline_variants&&) = delete;
+        ~pipeline_variants() {
+            for (auto& [constants, pipeline] : m_variants) {
+                D::destroy_pipeline(pipeline);
+            }
         }
-        void begin() {
+        pipeline_variants& operator=(const pipeline_variants&) = delete;
+        pipeline_variants& operator=(pipeline_variants&&) = delete;
+
+        VkPipeline get_pipeline_variant(std::span<const uint32_t> constants) {
+            auto key = std::vector<uint32_t>(constants.begin(), constants.end());
+            auto ite = m_variants.find(key);
+            if (ite == m_variants.end()) {
+                auto pipeline = build_pipeline(constants);
+                ite = m_variants.emplace(std::move(key), pipeline).first;
+            }
+            return ite->second;
+        }
+        auto get_pipeline_variant_count() const {
+            return m_variants.size();
+        }
+    private:
+        VkPipeline build_pipeline(std::span<const uint32_t> constants) {
+            auto entries = std::vector<VkSpecializationMapEntry>(constants.size());
+            for (uint32_t i = 0; i < entries.size(); i++) {
+                entries[i].constantID = i;
+                entries[i].offset = i * sizeof(uint32_t);
+                entries[i].size = sizeof(uint32_t);
+            }
+            VkSpecializationInfo specialization_info{};
+            specialization_info.mapEntryCount = static_cast<uint32_t>(entries.size());
+            specialization_info.pMapEntries = entries.data();
+            specialization_info.dataSize = constants.size_bytes();
+            specialization_info.pData = constants.data();
+
+            auto shader_module = m_shader_module.get_shader_module();
+            if constexpr (requires(D & d) { d.get_pipeline_cache(); }) {
+                auto start = std::chrono::steady_clock::now();
+                auto pipeline = D::create_pipeline(shader_module, D::get_pipeline_layout(), D::get_pipeline_cache(), {}, &specialization_info);
+                D::add_pipeline_creation_time(std::chrono::steady_clock::now() - start);
+                return pipeline;
+            }
+            else {
+                return D::create_pipeline(shader_module, D::get_pipeline_layout(), VK_NULL_HANDLE, {}, &specialization_info);
+            }
+        }
+
+        shader_module<D> m_shader_module;
+        std::map<std::vector<uint32_t>, VkPipeline> m_variants;
+    };
+
+    // records into a command buffer it does not own, shared by the command_buffer
+    // mixin and anything else that keeps command buffers of its own
+    class command_recorder {
+    public:
+        command_recorder(VkCommandBuffer command_buffer) : m_command_buffer{ command_buffer }
+        {}
+        void begin(VkCommandBufferUsageFlags flags = 0) {
             VkCommandBufferBeginInfo info{};
             info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            info.flags = flags;
             auto res = vkBeginCommandBuffer(m_command_buffer, &info);
             if (res != VK_SUCCESS) {
                 throw std::runtime_error{ "failed to begin command buffer" };
@@ -635,17 +1603,652 @@ namespace vulkan_helper {
         void bind_pipeline(VkPipelineBindPoint bind_point, VkPipeline pipeline) {
             vkCmdBindPipeline(m_command_buffer, bind_point, pipeline);
         }
+        VkCommandBuffer get_command_buffer() const {
+            return m_command_buffer;
+        }
         void bind_descriptor_set(VkPipelineBindPoint bind_point, VkPipelineLayout layout, VkDescriptorSet descriptor_set) {
             vkCmdBindDescriptorSets(m_command_buffer, bind_point,
                 layout, 0, 1, &descriptor_set, 0, NULL);
         }
-        void dispatch(uint32_t x, uint32_t y, uint32_t z) {
-            vkCmdDispatch(m_command_buffer, x, y, z);
+        // set 0 of layout, which was created with the push descriptor flag
+        void push_descriptor_set(const descriptor_functions& functions, VkPipelineBindPoint bind_point, VkPipelineLayout layout,
+            std::span<const VkWriteDescriptorSet> writes) {
+            if (functions.cmd_push_descriptor_set == nullptr) {
+                throw std::runtime_error{ "push descriptor mode not enabled on this device" };
+            }
+            functions.cmd_push_descriptor_set(m_command_buffer, bind_point, layout, 0,
+                static_cast<uint32_t>(writes.size()), writes.data());
+        }
+        // makes the resource descriptor buffer at address descriptor buffer 0
+        void bind_descriptor_buffer(const descriptor_functions& functions, VkDeviceAddress address) {
+            if (functions.cmd_bind_descriptor_buffers == nullptr) {
+                throw std::runtime_error{ "descriptor buffer mode not enabled on this device" };
+            }
+            VkDescriptorBufferBindingInfoEXT info{};
+            info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+            info.address = address;
+            info.usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT;
+            functions.cmd_bind_descriptor_buffers(m_command_buffer, 1, &info);
+        }
+        // set 0 of layout reads its descriptors at offset in descriptor buffer 0
+        void set_descriptor_buffer_offset(const descriptor_functions& functions, VkPipelineBindPoint bind_point, VkPipelineLayout layout,
+            VkDeviceSize offset) {
+            if (functions.cmd_set_descriptor_buffer_offsets == nullptr) {
+                throw std::runtime_error{ "descriptor buffer mode not enabled on this device" };
+            }
+            uint32_t buffer_index = 0;
+            functions.cmd_set_descriptor_buffer_offsets(m_command_buffer, bind_point, layout, 0, 1, &buffer_index, &offset);
+        }
+        void push_constants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* values) {
+            vkCmdPushConstants(m_command_buffer, layout, stages, offset, size, values);
+        }
+        void dispatch(uint32_t x, uint32_t y, uint32_t z) {
+            vkCmdDispatch(m_command_buffer, x, y, z);
+        }
+        void copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) {
+            VkBufferCopy region{};
+            region.srcOffset = 0;
+            region.dstOffset = 0;
+            region.size = size;
+            vkCmdCopyBuffer(m_command_buffer, src, dst, 1, &region);
+        }
+        void copy_buffer(VkBuffer src, VkDeviceSize src_offset, VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize size) {
+            VkBufferCopy region{};
+            region.srcOffset = src_offset;
+            region.dstOffset = dst_offset;
+            region.size = size;
+            vkCmdCopyBuffer(m_command_buffer, src, dst, 1, &region);
+        }
+        // fill and update are clear commands, VK_PIPELINE_STAGE_2_CLEAR_BIT with
+        // VK_ACCESS_2_TRANSFER_WRITE_BIT; offset and size are multiples of 4
+        void fill_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t data) {
+            vkCmdFillBuffer(m_command_buffer, buffer, offset, size, data);
+        }
+        // the data is copied into the command buffer, in one vkCmdUpdateBuffer
+        // per max_update_size bytes; meant for small data, every resubmission
+        // sends it to the device again
+        static constexpr size_t max_update_size = 65536;
+        void update_buffer(VkBuffer buffer, VkDeviceSize offset, std::span<const uint32_t> data) {
+            constexpr size_t max_words = max_update_size / sizeof(uint32_t);
+            for (size_t first = 0; first < data.size(); first += max_words) {
+                auto words = data.subspan(first, std::min(max_words, data.size() - first));
+                vkCmdUpdateBuffer(m_command_buffer, buffer, offset + first * sizeof(uint32_t), words.size_bytes(), words.data());
+            }
+        }
+        void memory_barrier(VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access) {
+            VkMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+            barrier.srcStageMask = src_stage;
+            barrier.srcAccessMask = src_access;
+            barrier.dstStageMask = dst_stage;
+            barrier.dstAccessMask = dst_access;
+            VkDependencyInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            info.memoryBarrierCount = 1;
+            info.pMemoryBarriers = &barrier;
+            vkCmdPipelineBarrier2(m_command_buffer, &info);
+        }
+        // whole buffer barrier; with different queue family indices it is the release
+        // half on the source queue and the acquire half on the destination queue
+        void buffer_barrier(VkBuffer buffer,
+            VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access,
+            uint32_t src_queue_family_index = VK_QUEUE_FAMILY_IGNORED, uint32_t dst_queue_family_index = VK_QUEUE_FAMILY_IGNORED) {
+            VkBufferMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+            barrier.srcStageMask = src_stage;
+            barrier.srcAccessMask = src_access;
+            barrier.dstStageMask = dst_stage;
+            barrier.dstAccessMask = dst_access;
+            barrier.srcQueueFamilyIndex = src_queue_family_index;
+            barrier.dstQueueFamilyIndex = dst_queue_family_index;
+            barrier.buffer = buffer;
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+            VkDependencyInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            info.bufferMemoryBarrierCount = 1;
+            info.pBufferMemoryBarriers = &barrier;
+            vkCmdPipelineBarrier2(m_command_buffer, &info);
+        }
+        // all barriers in one dependency, the sType of each must be set
+        void pipeline_barrier(std::span<const VkMemoryBarrier2> memory_barriers, std::span<const VkBufferMemoryBarrier2> buffer_barriers) {
+            VkDependencyInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            info.memoryBarrierCount = static_cast<uint32_t>(memory_barriers.size());
+            info.pMemoryBarriers = memory_barriers.data();
+            info.bufferMemoryBarrierCount = static_cast<uint32_t>(buffer_barriers.size());
+            info.pBufferMemoryBarriers = buffer_barriers.data();
+            vkCmdPipelineBarrier2(m_command_buffer, &info);
+        }
+        void reset_query_pool(VkQueryPool query_pool, uint32_t first_query, uint32_t query_count) {
+            vkCmdResetQueryPool(m_command_buffer, query_pool, first_query, query_count);
+        }
+        void write_timestamp(VkPipelineStageFlags2 stage, VkQueryPool query_pool, uint32_t query) {
+            vkCmdWriteTimestamp2(m_command_buffer, stage, query_pool, query);
         }
     private:
         VkCommandBuffer m_command_buffer;
     };
 
+    template<class D>
+    class command_buffer : public D {
+    public:
+        command_buffer() : m_command_buffer{D::allocate_command_buffer(D::get_command_pool())}
+        {}
+        auto get_command_buffer() const{
+            return m_command_buffer;
+        }
+        void begin() {
+            recorder().begin();
+        }
+        void end() {
+            recorder().end();
+        }
+        void bind_pipeline(VkPipelineBindPoint bind_point, VkPipeline pipeline) {
+            recorder().bind_pipeline(bind_point, pipeline);
+        }
+        void bind_descriptor_set(VkPipelineBindPoint bind_point, VkPipelineLayout layout, VkDescriptorSet descriptor_set) {
+            recorder().bind_descriptor_set(bind_point, layout, descriptor_set);
+        }
+        void push_constants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* values) {
+            recorder().push_constants(layout, stages, offset, size, values);
+        }
+        void dispatch(uint32_t x, uint32_t y, uint32_t z) {
+            recorder().dispatch(x, y, z);
+        }
+        void copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) {
+            recorder().copy_buffer(src, dst, size);
+        }
+        void fill_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t data) {
+            recorder().fill_buffer(buffer, offset, size, data);
+        }
+        void update_buffer(VkBuffer buffer, VkDeviceSize offset, std::span<const uint32_t> data) {
+            recorder().update_buffer(buffer, offset, data);
+        }
+        void memory_barrier(VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access) {
+            recorder().memory_barrier(src_stage, src_access, dst_stage, dst_access);
+        }
+        void buffer_barrier(VkBuffer buffer,
+            VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access,
+            uint32_t src_queue_family_index = VK_QUEUE_FAMILY_IGNORED, uint32_t dst_queue_family_index = VK_QUEUE_FAMILY_IGNORED) {
+            recorder().buffer_barrier(buffer, src_stage, src_access, dst_stage, dst_access, src_queue_family_index, dst_queue_family_index);
+        }
+        void pipeline_barrier(std::span<const VkMemoryBarrier2> memory_barriers, std::span<const VkBufferMemoryBarrier2> buffer_barriers) {
+            recorder().pipeline_barrier(memory_barriers, buffer_barriers);
+        }
+        void reset_query_pool(VkQueryPool query_pool, uint32_t first_query, uint32_t query_count) {
+            recorder().reset_query_pool(query_pool, first_query, query_count);
+        }
+        void write_timestamp(VkPipelineStageFlags2 stage, VkQueryPool query_pool, uint32_t query) {
+            recorder().write_timestamp(stage, query_pool, query);
+        }
+    private:
+        command_recorder recorder() {
+            return command_recorder{ m_command_buffer };
+        }
+        VkCommandBuffer m_command_buffer;
+    };
+
+    // Binds storage buffers to set 0 anew for every dispatch, the way the
+    // device's descriptor mode does it: a fresh set from a pool of its own, a
+    // push descriptor write, or a slot of a descriptor buffer. Set and buffer
+    // slots are handed out until reset_descriptor_bindings, at most
+    // get_descriptor_binding_capacity() between two resets. Takes the place of
+    // descriptor_pool and descriptor_set in a chain.
+    template<class D>
+    class descriptor_binder : public D {
+    public:
+        static constexpr uint32_t default_capacity = 256;
+
+        descriptor_binder() : m_capacity{ get_capacity() } {
+            if (D::get_descriptor_mode() == descriptor_mode::descriptor_set) {
+                auto pool_sizes = get_pool_sizes();
+                m_descriptor_pool = D::create_descriptor_pool(m_capacity, std::span<const VkDescriptorPoolSize>{ pool_sizes });
+            }
+            else if (D::get_descriptor_mode() == descriptor_mode::descriptor_buffer) {
+                create_descriptor_buffer();
+            }
+        }
+        descriptor_binder(const descriptor_binder&) = delete;
+        descriptor_binder(descriptor_binder&&) = delete;
+        ~descriptor_binder() {
+            if (m_descriptor_pool != VK_NULL_HANDLE) {
+                D::destroy_descriptor_pool(m_descriptor_pool);
+            }
+            if (m_descriptor_buffer != VK_NULL_HANDLE) {
+                D::unmap_device_memory(m_descriptor_memory);
+                D::free_device_memory(m_descriptor_memory);
+                D::destroy_buffer(m_descriptor_buffer);
+            }
+        }
+        descriptor_binder& operator=(const descriptor_binder&) = delete;
+        descriptor_binder& operator=(descriptor_binder&&) = delete;
+
+        uint32_t get_descriptor_binding_capacity() const {
+            return m_capacity;
+        }
+        // bindings since the last reset
+        uint32_t get_descriptor_binding_count() const {
+            return m_binding_count;
+        }
+        // only once the device is done with every command buffer recorded since
+        // the last reset, and before re-recording any of them
+        void reset_descriptor_bindings() {
+            if (m_descriptor_pool != VK_NULL_HANDLE) {
+                D::reset_descriptor_pool(m_descriptor_pool);
+            }
+            m_binding_count = 0;
+            m_bound_command_buffer = VK_NULL_HANDLE;
+        }
+        // buffers[i] to binding i for the dispatches recorded after this; in
+        // descriptor_buffer mode every range must be explicit, not VK_WHOLE_SIZE
+        void bind_storage_buffers(command_recorder& recorder, VkPipelineBindPoint bind_point, VkPipelineLayout layout,
+            std::span<const VkDescriptorBufferInfo> buffers) {
+            auto mode = D::get_descriptor_mode();
+            if (mode != descriptor_mode::push_descriptor && m_binding_count == m_capacity) {
+                throw std::runtime_error{ "descriptor bindings exhausted, reset them" };
+            }
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstBinding = 0;
+            write.dstArrayElement = 0;
+            write.descriptorCount = static_cast<uint32_t>(buffers.size());
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.pBufferInfo = buffers.data();
+            switch (mode) {
+            case descriptor_mode::push_descriptor:
+                recorder.push_descriptor_set(D::get_descriptor_functions(), bind_point, layout,
+                    std::span<const VkWriteDescriptorSet>{ &write, 1 });
+                break;
+            case descriptor_mode::descriptor_buffer:
+                bind_descriptor_buffer_slot(recorder, bind_point, layout, buffers);
+                break;
+            default:
+                write.dstSet = D::allocate_descriptor_set(m_descriptor_pool, D::get_descriptor_set_layout());
+                D::update_descriptor_set(write);
+                recorder.bind_descriptor_set(bind_point, layout, write.dstSet);
+                break;
+            }
+            m_binding_count++;
+        }
+    private:
+        uint32_t get_capacity() {
+            if constexpr (requires(D & d) { d.get_descriptor_binding_capacity(); }) {
+                return D::get_descriptor_binding_capacity();
+            }
+            else {
+                return default_capacity;
+            }
+        }
+        std::vector<VkDescriptorPoolSize> get_pool_sizes() {
+            return get_descriptor_pool_sizes(D::get_shader_reflection(), m_capacity);
+        }
+        // one slot per binding, each aligned for vkCmdSetDescriptorBufferOffsetsEXT
+        void create_descriptor_buffer() {
+            auto properties = D::get_descriptor_buffer_properties();
+            auto alignment = std::max<VkDeviceSize>(properties.descriptorBufferOffsetAlignment, 1);
+            m_descriptor_size = properties.storageBufferDescriptorSize;
+            m_slot_size = (D::get_descriptor_set_layout_size(D::get_descriptor_set_layout()) + alignment - 1) / alignment * alignment;
+            m_descriptor_buffer = D::create_buffer(D::get_compute_queue_family_index(), m_slot_size * m_capacity,
+                VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT);
+            m_descriptor_memory = D::alloc_device_memory(D::get_memory_properties(), m_descriptor_buffer,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            m_descriptors = static_cast<std::byte*>(D::map_device_memory(m_descriptor_memory, 0, VK_WHOLE_SIZE));
+            m_descriptor_buffer_address = D::get_buffer_device_address(m_descriptor_buffer);
+        }
+        VkDeviceSize get_binding_offset(uint32_t binding) {
+            while (m_binding_offsets.size() <= binding) {
+                m_binding_offsets.push_back(D::get_descriptor_set_layout_binding_offset(D::get_descriptor_set_layout(),
+                    static_cast<uint32_t>(m_binding_offsets.size())));
+            }
+            return m_binding_offsets[binding];
+        }
+        void bind_descriptor_buffer_slot(command_recorder& recorder, VkPipelineBindPoint bind_point, VkPipelineLayout layout,
+            std::span<const VkDescriptorBufferInfo> buffers) {
+            auto slot = m_binding_count * m_slot_size;
+            for (uint32_t i = 0; i < buffers.size(); i++) {
+                auto& buffer = buffers[i];
+                if (buffer.range == VK_WHOLE_SIZE) {
+                    throw std::runtime_error{ "descriptor buffer bindings need explicit ranges" };
+                }
+                D::get_storage_buffer_descriptor(D::get_buffer_device_address(buffer.buffer) + buffer.offset, buffer.range,
+                    m_descriptors + slot + get_binding_offset(i), m_descriptor_size);
+            }
+            // binding a descriptor buffer can be costly, so it is bound once per command buffer
+            if (recorder.get_command_buffer() != m_bound_command_buffer) {
+                recorder.bind_descriptor_buffer(D::get_descriptor_functions(), m_descriptor_buffer_address);
+                m_bound_command_buffer = recorder.get_command_buffer();
+            }
+            recorder.set_descriptor_buffer_offset(D::get_descriptor_functions(), bind_point, layout, slot);
+        }
+
+        uint32_t m_capacity;
+        uint32_t m_binding_count = 0;
+        VkDescriptorPool m_descriptor_pool = VK_NULL_HANDLE;
+        VkBuffer m_descriptor_buffer = VK_NULL_HANDLE;
+        VkDeviceMemory m_descriptor_memory = VK_NULL_HANDLE;
+        std::byte* m_descriptors = nullptr;
+        VkDeviceAddress m_descriptor_buffer_address = 0;
+        VkDeviceSize m_slot_size = 0;
+        size_t m_descriptor_size = 0;
+        std::vector<VkDeviceSize> m_binding_offsets;
+        VkCommandBuffer m_bound_command_buffer = VK_NULL_HANDLE;
+    };
+
+    // turns two timestamps of one queue family into the time between them
+    class timestamp_clock {
+    public:
+        timestamp_clock(float period, uint32_t valid_bits) :
+            m_period{ period },
+            m_valid_bits{ valid_bits },
+            m_mask{ valid_bits >= 64 ? ~uint64_t{ 0 } : (uint64_t{ 1 } << valid_bits) - 1 }
+        {}
+        bool has_timestamps() const {
+            return m_valid_bits != 0;
+        }
+        // the counter wraps at valid_bits, so the difference is taken modulo that
+        std::chrono::duration<double, std::nano> get_duration(uint64_t begin, uint64_t end) const {
+            return std::chrono::duration<double, std::nano>{ ((end - begin) & m_mask) * static_cast<double>(m_period) };
+        }
+    private:
+        float m_period;
+        uint32_t m_valid_bits;
+        uint64_t m_mask;
+    };
+
+    template<class D>
+    timestamp_clock get_compute_timestamp_clock(D& device) {
+        return timestamp_clock{ device.get_properties().limits.timestampPeriod,
+            device.get_queue_family_properties(device.get_compute_queue_family_index()).timestampValidBits };
+    }
+
+    struct timestamp_region {
+        std::string name;
+        std::chrono::duration<double, std::nano> duration;
+    };
+
+    // brackets regions of the recorded command buffer with timestamps;
+    // durations are valid once the submission that executed them has completed.
+    // Regions never ended, or not executed yet, are left out.
+    template<class D>
+    class timestamp_query_pool : public D {
+    public:
+        static constexpr uint32_t max_regions = 64;
+
+        timestamp_query_pool() :
+            m_query_pool{ D::create_query_pool(VK_QUERY_TYPE_TIMESTAMP, 2 * max_regions) },
+            m_timestamp_clock{ get_compute_timestamp_clock(static_cast<D&>(*this)) }
+        {}
+        timestamp_query_pool(const timestamp_query_pool&) = delete;
+        timestamp_query_pool(timestamp_query_pool&&) = delete;
+        ~timestamp_query_pool() {
+            D::destroy_query_pool(m_query_pool);
+        }
+        timestamp_query_pool& operator=(const timestamp_query_pool&) = delete;
+        timestamp_query_pool& operator=(timestamp_query_pool&&) = delete;
+
+        bool has_timestamps() const {
+            return m_timestamp_clock.has_timestamps();
+        }
+        // record once per command buffer, before the first region
+        void reset_timestamps() {
+            m_region_names.clear();
+            m_region_ended.clear();
+            if (has_timestamps()) {
+                D::reset_query_pool(m_query_pool, 0, 2 * max_regions);
+            }
+        }
+        uint32_t begin_region(std::string name) {
+            if (m_region_names.size() >= max_regions) {
+                throw std::runtime_error{ "too many timestamp regions" };
+            }
+            auto region = static_cast<uint32_t>(m_region_names.size());
+            m_region_names.emplace_back(std::move(name));
+            m_region_ended.push_back(false);
+            if (has_timestamps()) {
+                D::write_timestamp(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_query_pool, 2 * region);
+            }
+            return region;
+        }
+        void end_region(uint32_t region) {
+            if (region >= m_region_ended.size()) {
+                throw std::runtime_error{ "timestamp region never begun" };
+            }
+            m_region_ended[region] = true;
+            if (has_timestamps()) {
+                D::write_timestamp(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_query_pool, 2 * region + 1);
+            }
+        }
+        auto get_region_durations() {
+            auto regions = std::vector<timestamp_region>{};
+            if (!has_timestamps() || m_region_names.empty()) {
+                return regions;
+            }
+            auto ticks = D::get_available_query_pool_results(m_query_pool, 0, 2 * static_cast<uint32_t>(m_region_names.size()));
+            for (size_t i = 0; i < m_region_names.size(); i++) {
+                if (!m_region_ended[i] || !ticks[2 * i] || !ticks[2 * i + 1]) {
+                    continue;
+                }
+                regions.emplace_back(m_region_names[i], m_timestamp_clock.get_duration(*ticks[2 * i], *ticks[2 * i + 1]));
+            }
+            return regions;
+        }
+    private:
+        VkQueryPool m_query_pool;
+        timestamp_clock m_timestamp_clock;
+        std::vector<std::string> m_region_names;
+        std::vector<bool> m_region_ended;
+    };
+
+    struct memory_allocation {
+        VkDeviceMemory memory;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        uint32_t memory_type_index;
+        // host pointer to offset, nullptr unless the memory type is host visible
+        void* mapped;
+        uint32_t block;
+    };
+
+    struct memory_allocator_statistics {
+        uint32_t block_count;
+        uint32_t allocation_count;
+        VkDeviceSize block_bytes;
+        VkDeviceSize allocated_bytes;
+        VkDeviceSize peak_allocated_bytes;
+        uint64_t device_allocation_count;
+    };
+
+    // Sub-allocates buffers out of large per memory type blocks, so thousands
+    // of buffers cost a handful of vkAllocateMemory calls. Host visible blocks
+    // stay mapped for their whole lifetime. Only buffers are placed in the
+    // blocks, so bufferImageGranularity never applies.
+    template<class D>
+    class memory_allocator : public D {
+    public:
+        static constexpr VkDeviceSize default_block_size = VkDeviceSize{ 64 } << 20;
+
+        memory_allocator() = default;
+        memory_allocator(const memory_allocator&) = delete;
+        memory_allocator(memory_allocator&&) = delete;
+        ~memory_allocator() {
+            for (auto& block : m_blocks) {
+                release_block(block);
+            }
+        }
+        memory_allocator& operator=(const memory_allocator&) = delete;
+        memory_allocator& operator=(memory_allocator&&) = delete;
+
+        // picks a memory type with property | preferred_property if there is one, else with property only
+        memory_allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags property, VkMemoryPropertyFlags preferred_property = 0) {
+            auto memory_type_index = find_memory_type(requirements.memoryTypeBits, property, preferred_property);
+            auto alignment = requirements.alignment > 0 ? requirements.alignment : 1;
+            auto size = requirements.size;
+            // non coherent memory is flushed and invalidated in whole atoms, so two
+            // allocations must never share one
+            if (is_non_coherent(memory_type_index)) {
+                auto atom_size = get_non_coherent_atom_size();
+                alignment = std::max(alignment, atom_size);
+                size = (size + atom_size - 1) / atom_size * atom_size;
+            }
+            for (uint32_t i = 0; i < m_blocks.size(); i++) {
+                auto& block = m_blocks[i];
+                if (block.memory == VK_NULL_HANDLE || block.memory_type_index != memory_type_index) {
+                    continue;
+                }
+                if (auto offset = block.free_list.allocate(size, alignment)) {
+                    return make_allocation(i, *offset, size);
+                }
+            }
+            auto i = create_block(memory_type_index, size);
+            auto offset = m_blocks[i].free_list.allocate(size, alignment);
+            if (!offset) {
+                throw std::runtime_error{ "failed to sub-allocate device memory" };
+            }
+            return make_allocation(i, *offset, size);
+        }
+        memory_allocation allocate_buffer_memory(VkBuffer buffer, VkMemoryPropertyFlags property, VkMemoryPropertyFlags preferred_property = 0) {
+            auto allocation = allocate(D::get_buffer_memory_requirements(buffer), property, preferred_property);
+            D::bind_buffer_memory(buffer, allocation.memory, allocation.offset);
+            return allocation;
+        }
+        void free(const memory_allocation& allocation) {
+            auto& block = m_blocks[allocation.block];
+            block.free_list.free(allocation.offset, allocation.size);
+            m_allocation_count--;
+            m_allocated_bytes -= allocation.size;
+            // blocks made for a single allocation are not kept around
+            if (block.free_list.empty() && block.single_allocation) {
+                release_block(block);
+            }
+        }
+
+        auto get_memory_allocator_statistics() const {
+            memory_allocator_statistics statistics{};
+            for (auto& block : m_blocks) {
+                if (block.memory != VK_NULL_HANDLE) {
+                    statistics.block_count++;
+                    statistics.block_bytes += block.free_list.size();
+                }
+            }
+            statistics.allocation_count = m_allocation_count;
+            statistics.allocated_bytes = m_allocated_bytes;
+            statistics.peak_allocated_bytes = m_peak_allocated_bytes;
+            statistics.device_allocation_count = m_device_allocation_count;
+            return statistics;
+        }
+        bool is_non_coherent(uint32_t memory_type_index) {
+            auto flags = D::get_memory_properties().memoryTypes[memory_type_index].propertyFlags;
+            return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        }
+        VkDeviceSize get_non_coherent_atom_size() {
+            if (m_non_coherent_atom_size == 0) {
+                m_non_coherent_atom_size = std::max<VkDeviceSize>(D::get_properties().limits.nonCoherentAtomSize, 1);
+            }
+            return m_non_coherent_atom_size;
+        }
+    private:
+        struct block {
+            VkDeviceMemory memory;
+            uint32_t memory_type_index;
+            std::byte* mapped;
+            free_list_suballocator free_list;
+            // sized for an allocation larger than a regular block
+            bool single_allocation;
+        };
+
+        uint32_t create_block(uint32_t memory_type_index, VkDeviceSize min_size) {
+            const auto& memory_properties = D::get_memory_properties();
+            auto& memory_type = memory_properties.memoryTypes[memory_type_index];
+            // keep a block well below the heap size so small heaps (e.g. BAR) still fit several
+            auto heap_size = memory_properties.memoryHeaps[memory_type.heapIndex].size;
+            auto regular_size = std::min(m_block_size, std::max<VkDeviceSize>(heap_size / 8, 1));
+            auto block_size = std::max(regular_size, min_size);
+            if (is_non_coherent(memory_type_index)) {
+                auto atom_size = get_non_coherent_atom_size();
+                block_size = (block_size + atom_size - 1) / atom_size * atom_size;
+            }
+
+            auto memory = D::allocate_memory(block_size, memory_type_index);
+            m_device_allocation_count++;
+            std::byte* mapped = nullptr;
+            if (memory_type.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+                mapped = static_cast<std::byte*>(D::map_device_memory(memory, 0, VK_WHOLE_SIZE));
+            }
+            auto new_block = block{ memory, memory_type_index, mapped, free_list_suballocator{ block_size }, min_size > regular_size };
+            for (uint32_t i = 0; i < m_blocks.size(); i++) {
+                if (m_blocks[i].memory == VK_NULL_HANDLE) {
+                    m_blocks[i] = std::move(new_block);
+                    return i;
+                }
+            }
+            m_blocks.emplace_back(std::move(new_block));
+            return static_cast<uint32_t>(m_blocks.size() - 1);
+        }
+        uint32_t find_memory_type(uint32_t memory_type_bits, VkMemoryPropertyFlags property, VkMemoryPropertyFlags preferred_property) {
+            if (preferred_property != 0) {
+                try {
+                    return D::findProperties(D::get_memory_properties(), memory_type_bits, property | preferred_property);
+                }
+                catch (std::runtime_error&) {
+                }
+            }
+            return D::findProperties(D::get_memory_properties(), memory_type_bits, property);
+        }
+        void release_block(block& block) {
+            if (block.memory == VK_NULL_HANDLE) {
+                return;
+            }
+            if (block.mapped != nullptr) {
+                D::unmap_device_memory(block.memory);
+            }
+            D::free_device_memory(block.memory);
+            block.memory = VK_NULL_HANDLE;
+            block.mapped = nullptr;
+        }
+        memory_allocation make_allocation(uint32_t i, VkDeviceSize offset, VkDeviceSize size) {
+            auto& block = m_blocks[i];
+            m_allocation_count++;
+            m_allocated_bytes += size;
+            m_peak_allocated_bytes = std::max(m_peak_allocated_bytes, m_allocated_bytes);
+            return memory_allocation{
+                block.memory, offset, size, block.memory_type_index,
+                block.mapped != nullptr ? block.mapped + offset : nullptr,
+                i };
+        }
+
+        VkDeviceSize m_block_size = default_block_size;
+        VkDeviceSize m_non_coherent_atom_size = 0;
+        std::vector<block> m_blocks;
+        uint32_t m_allocation_count = 0;
+        VkDeviceSize m_allocated_bytes = 0;
+        VkDeviceSize m_peak_allocated_bytes = 0;
+        uint64_t m_device_allocation_count = 0;
+    };
+
+    enum class storage_location {
+        // mapped directly, the kernel accesses host visible memory
+        host_visible,
+        // mapped directly, preferring host cached memory for fast readback; it may be
+        // non coherent, see add_mapped_memory_ranges
+        host_cached,
+        // device local, the host goes through a staging buffer copied with vkCmdCopyBuffer
+        device_local,
+    };
+
+    // the memory a storage buffer at location is bound to
+    template<class Allocator>
+    memory_allocation allocate_storage_memory(Allocator& allocator, VkBuffer buffer, storage_location location) {
+        switch (location) {
+        case storage_location::device_local:
+            return allocator.allocate_buffer_memory(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        case storage_location::host_cached:
+            return allocator.allocate_buffer_memory(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        default:
+            return allocator.allocate_buffer_memory(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        }
+    }
+
     template<class D>
     class add_storage_buffer : public D {
     public:
@@ -681,7 +2284,8 @@ namespace vulkan_helper {
                 buffer_sizes.end(),
                 buffers.begin(),
                 [this](auto size) {
-                    return D::create_buffer(D::get_compute_queue_family_index(), size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+                    return D::create_buffer(D::get_compute_queue_family_index(), size,
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
                 }
             );
             return buffers;
@@ -707,33 +2311,62 @@ namespace vulkan_helper {
     template<class D>
     class add_storage_memories : public D {
     public:
-        add_storage_memories() : m_storage_memories(create_memories(D::get_storage_buffers()))
+        add_storage_memories() : m_storage_allocations(create_memories(D::get_storage_buffers()))
         {}
         ~add_storage_memories() {
-            for (auto memory : m_storage_memories) {
-                D::free_device_memory(memory);
+            for (auto& allocation : m_storage_allocations) {
+                D::free(allocation);
             }
         }
         auto get_storage_memories() const {
-            return m_storage_memories;
-        }
-    private:
-        auto create_memories(const auto& buffers) {
-            auto memories = std::vector<VkDeviceMemory>(buffers.size());
+            auto memories = std::vector<VkDeviceMemory>(m_storage_allocations.size());
             std::transform(
-                buffers.begin(),
-                buffers.end(),
+                m_storage_allocations.begin(),
+                m_storage_allocations.end(),
                 memories.begin(),
-                [this](const auto& buffer) {
-                    return D::alloc_device_memory(
-                            D::get_memory_properties(),
-                            buffer,
-                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+                [](const auto& allocation) {
+                    return allocation.memory;
                 }
             );
             return memories;
         }
-        std::vector<VkDeviceMemory> m_storage_memories;
+        const auto& get_storage_allocations() const {
+            return m_storage_allocations;
+        }
+    private:
+        auto create_memories(const auto& buffers) {
+            auto allocations = std::vector<memory_allocation>{};
+            allocations.reserve(buffers.size());
+            for (size_t i = 0; i < buffers.size(); i++) {
+                allocations.emplace_back(allocate_memory(buffers[i], i));
+            }
+            return allocations;
+        }
+        memory_allocation allocate_memory(VkBuffer buffer, size_t i) {
+            auto location = storage_location::host_visible;
+            if constexpr (requires(D & d) { d.get_storage_buffer_locations(); }) {
+                location = D::get_storage_buffer_locations()[i];
+            }
+            return allocate_storage_memory(static_cast<D&>(*this), buffer, location);
+        }
+        std::vector<memory_allocation> m_storage_allocations;
+    };
+
+    // 64 bit addresses of the storage buffers, for kernels that take them as
+    // buffer references; the device needs buffer device address enabled
+    template<class D>
+    class add_storage_buffer_addresses : public D {
+    public:
+        add_storage_buffer_addresses() {
+            for (auto buffer : D::get_storage_buffers()) {
+                m_storage_buffer_addresses.push_back(D::get_buffer_device_address(buffer));
+            }
+        }
+        const auto& get_storage_buffer_addresses() const {
+            return m_storage_buffer_addresses;
+        }
+    private:
+        std::vector<VkDeviceAddress> m_storage_buffer_addresses;
     };
 
     template<class D>
@@ -751,39 +2384,594 @@ namespace vulkan_helper {
         void* m_storage_memory_ptr;
     };
 
+    // Gives every device local storage buffer a host visible twin of the same
+    // size. record_staging_uploads/record_staging_readbacks copy between the
+    // two around the kernel, so the host only ever touches the staging side.
     template<class D>
-    class add_storage_memory_ptrs : public D {
+    class add_staging_buffers : public D {
     public:
-        add_storage_memory_ptrs() : m_storage_memory_ptrs{map_memories(D::get_storage_memories(), D::get_storage_buffer_sizes())}
-        {
+        add_staging_buffers() {
+            auto buffers = D::get_storage_buffers();
+            auto sizes = D::get_storage_buffer_sizes();
+            auto locations = D::get_storage_buffer_locations();
+            m_staging_buffers.resize(buffers.size(), VK_NULL_HANDLE);
+            m_staging_allocations.resize(buffers.size());
+            for (size_t i = 0; i < buffers.size(); i++) {
+                if (locations[i] != storage_location::device_local) {
+                    continue;
+                }
+                m_staging_buffers[i] = D::create_buffer(D::get_compute_queue_family_index(), sizes[i],
+                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                m_staging_allocations[i] = D::allocate_buffer_memory(m_staging_buffers[i],
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+            }
+        }
+        add_staging_buffers(const add_staging_buffers&) = delete;
+        add_staging_buffers(add_staging_buffers&&) = delete;
+        ~add_staging_buffers() {
+            for (size_t i = 0; i < m_staging_buffers.size(); i++) {
+                if (m_staging_buffers[i] != VK_NULL_HANDLE) {
+                    D::destroy_buffer(m_staging_buffers[i]);
+                    D::free(m_staging_allocations[i]);
+                }
+            }
+        }
+        add_staging_buffers& operator=(const add_staging_buffers&) = delete;
+        add_staging_buffers& operator=(add_staging_buffers&&) = delete;
+
+        // VK_NULL_HANDLE for storage buffers that are host visible themselves
+        const auto& get_staging_buffers() const {
+            return m_staging_buffers;
         }
-        ~add_storage_memory_ptrs() {
-            for (auto memory : D::get_storage_memories()) {
-                D::unmap_device_memory(memory);
+        const auto& get_staging_allocations() const {
+            return m_staging_allocations;
+        }
+        // host writes are visible to the device at submit, so only the copy needs ordering against the kernel
+        void record_staging_uploads() {
+            if (!record_copies(true)) {
+                return;
+            }
+            D::memory_barrier(
+                VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        }
+        void record_staging_readbacks() {
+            if (!has_staging_buffers()) {
+                return;
+            }
+            D::memory_barrier(
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+            record_copies(false);
+            D::memory_barrier(
+                VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+        }
+    private:
+        bool has_staging_buffers() const {
+            return std::any_of(m_staging_buffers.begin(), m_staging_buffers.end(),
+                [](auto buffer) { return buffer != VK_NULL_HANDLE; });
+        }
+        bool record_copies(bool upload) {
+            auto buffers = D::get_storage_buffers();
+            auto sizes = D::get_storage_buffer_sizes();
+            bool recorded = false;
+            for (size_t i = 0; i < buffers.size(); i++) {
+                if (m_staging_buffers[i] == VK_NULL_HANDLE) {
+                    continue;
+                }
+                if (upload) {
+                    D::copy_buffer(m_staging_buffers[i], buffers[i], sizes[i]);
+                }
+                else {
+                    D::copy_buffer(buffers[i], m_staging_buffers[i], sizes[i]);
+                }
+                recorded = true;
             }
+            return recorded;
+        }
+
+        std::vector<VkBuffer> m_staging_buffers;
+        std::vector<memory_allocation> m_staging_allocations;
+    };
+
+    // storage memories come from memory_allocator, which keeps host visible blocks
+    // mapped, so this only hands out the pointers; device local buffers are
+    // reached through their staging buffer
+    template<class D>
+    class add_storage_memory_ptrs : public D {
+    public:
+        add_storage_memory_ptrs() : m_storage_memory_ptrs{map_memories(D::get_storage_allocations())}
+        {
         }
         auto get_storage_memory_ptrs() const {
             return m_storage_memory_ptrs;
         }
     private:
-        auto map_memories(auto memories, auto memory_sizes) {
-            std::vector<void*> ptrs(memories.size());
-            std::vector<uint32_t> indices(memories.size());
-            std::iota(indices.begin(), indices.end(), 0);
-            std::transform(
-                indices.begin(),
-                indices.end(),
-                ptrs.begin(),
-                [&memories, &memory_sizes, this](auto i) {
-                    auto& memory = memories[i];
-                    auto& size = memory_sizes[i];
-                    return D::map_device_memory(memory, 0, size);
-                });
+        // a storage buffer with a staging twin is only ever touched through
+        // the twin, even where device local memory is host visible too
+        auto map_memories(const auto& allocations) {
+            std::vector<void*> ptrs(allocations.size());
+            for (size_t i = 0; i < allocations.size(); i++) {
+                ptrs[i] = allocations[i].mapped;
+                if constexpr (requires(D & d) { d.get_staging_allocations(); }) {
+                    if (D::get_staging_buffers()[i] != VK_NULL_HANDLE) {
+                        ptrs[i] = D::get_staging_allocations()[i].mapped;
+                    }
+                }
+                if (ptrs[i] == nullptr) {
+                    throw std::runtime_error{ "storage memory is not host visible" };
+                }
+            }
             return ptrs;
         }
         std::vector<void*> m_storage_memory_ptrs;
     };
 
+    // batch of mapped memory ranges; merge() sorts them and joins overlapping or
+    // touching ranges of the same memory so they go out in one vkFlush/vkInvalidate call
+    class mapped_memory_ranges {
+    public:
+        void add(VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size) {
+            VkMappedMemoryRange range{};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = memory;
+            range.offset = offset;
+            range.size = size;
+            m_ranges.push_back(range);
+        }
+        std::span<const VkMappedMemoryRange> merge() {
+            std::sort(m_ranges.begin(), m_ranges.end(),
+                [](const auto& lhs, const auto& rhs) {
+                    return lhs.memory != rhs.memory ? lhs.memory < rhs.memory : lhs.offset < rhs.offset;
+                });
+            size_t count = 0;
+            for (auto& range : m_ranges) {
+                if (count > 0) {
+                    auto& last = m_ranges[count - 1];
+                    if (last.memory == range.memory && range.offset <= last.offset + last.size) {
+                        last.size = std::max(last.offset + last.size, range.offset + range.size) - last.offset;
+                        continue;
+                    }
+                }
+                m_ranges[count++] = range;
+            }
+            m_ranges.resize(count);
+            return m_ranges;
+        }
+        bool empty() const {
+            return m_ranges.empty();
+        }
+        void clear() {
+            m_ranges.clear();
+        }
+    private:
+        std::vector<VkMappedMemoryRange> m_ranges;
+    };
+
+    // Dirty range tracking for the mapped storage and staging memories. Host code
+    // marks what it wrote or is about to read by host pointer; the ranges are
+    // widened to nonCoherentAtomSize, merged and sent in a single
+    // vkFlushMappedMemoryRanges/vkInvalidateMappedMemoryRanges call. Ranges in
+    // coherent memory are dropped, so the calls cost nothing there.
+    template<class D>
+    class add_mapped_memory_ranges : public D {
+    public:
+        add_mapped_memory_ranges() :
+            m_non_coherent_atom_size{ std::max<VkDeviceSize>(D::get_properties().limits.nonCoherentAtomSize, 1) },
+            m_mappings{ collect_mappings() }
+        {}
+
+        void mark_host_written(const void* ptr, size_t size) {
+            add_range(m_flush_ranges, ptr, size);
+        }
+        void mark_host_read(const void* ptr, size_t size) {
+            add_range(m_invalidate_ranges, ptr, size);
+        }
+        // call after host writes and before the submit that reads them
+        void flush_host_writes() {
+            if (!m_flush_ranges.empty()) {
+                D::flush_mapped_memory_ranges(m_flush_ranges.merge());
+                m_flush_ranges.clear();
+            }
+        }
+        // call after the device work completed and before the host reads
+        void invalidate_host_reads() {
+            if (!m_invalidate_ranges.empty()) {
+                D::invalidate_mapped_memory_ranges(m_invalidate_ranges.merge());
+                m_invalidate_ranges.clear();
+            }
+        }
+    private:
+        struct mapping {
+            const std::byte* begin;
+            const std::byte* end;
+            VkDeviceMemory memory;
+            VkDeviceSize offset;
+            bool coherent;
+        };
+        auto collect_mappings() {
+            auto mappings = std::vector<mapping>{};
+            auto add_allocations = [this, &mappings](const auto& allocations) {
+                for (auto& allocation : allocations) {
+                    if (allocation.mapped == nullptr) {
+                        continue;
+                    }
+                    auto flags = D::get_memory_properties().memoryTypes[allocation.memory_type_index].propertyFlags;
+                    auto begin = static_cast<const std::byte*>(allocation.mapped);
+                    mappings.emplace_back(begin, begin + allocation.size, allocation.memory, allocation.offset,
+                        (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0);
+                }
+            };
+            add_allocations(D::get_storage_allocations());
+            if constexpr (requires(D & d) { d.get_staging_allocations(); }) {
+                add_allocations(D::get_staging_allocations());
+            }
+            std::sort(mappings.begin(), mappings.end(),
+                [](const auto& lhs, const auto& rhs) { return lhs.begin < rhs.begin; });
+            return mappings;
+        }
+        void add_range(mapped_memory_ranges& ranges, const void* ptr, size_t size) {
+            auto begin = static_cast<const std::byte*>(ptr);
+            auto ite = std::upper_bound(m_mappings.begin(), m_mappings.end(), begin,
+                [](const std::byte* p, const mapping& m) { return p < m.begin; });
+            if (ite == m_mappings.begin() || begin >= std::prev(ite)->end) {
+                throw std::runtime_error{ "pointer is not in a mapped storage memory" };
+            }
+            auto& m = *std::prev(ite);
+            if (m.coherent || size == 0) {
+                return;
+            }
+            // allocations of non coherent memory are atom aligned, so rounding stays inside the allocation
+            auto first = static_cast<VkDeviceSize>(begin - m.begin);
+            auto last = std::min(first + size, static_cast<VkDeviceSize>(m.end - m.begin));
+            first = first / m_non_coherent_atom_size * m_non_coherent_atom_size;
+            last = (last + m_non_coherent_atom_size - 1) / m_non_coherent_atom_size * m_non_coherent_atom_size;
+            ranges.add(m.memory, m.offset + first, last - first);
+        }
+
+        VkDeviceSize m_non_coherent_atom_size;
+        std::vector<mapping> m_mappings;
+        mapped_memory_ranges m_flush_ranges;
+        mapped_memory_ranges m_invalidate_ranges;
+    };
+
+    struct ring_frame {
+        uint32_t index;
+        VkCommandBuffer command_buffer;
+        // staging to device local copies for the transfer queue, VK_NULL_HANDLE if all storage is host visible
+        VkCommandBuffer upload_command_buffer;
+        VkDescriptorSet descriptor_set;
+        std::vector<VkBuffer> storage_buffers;
+        std::vector<memory_allocation> storage_allocations;
+        // VK_NULL_HANDLE for storage buffers that are host visible themselves
+        std::vector<VkBuffer> staging_buffers;
+        std::vector<memory_allocation> staging_allocations;
+        // first of the two timestamp queries bracketing the frame
+        uint32_t first_query;
+        // timeline value signaled by the last submit of this frame, 0 if never submitted
+        uint64_t submission;
+        // set by acquire_frame when it retired a submission, the storage then holds its results
+        bool has_results;
+        bool in_flight;
+
+        // the memory the host fills and reads for storage buffer i
+        const memory_allocation& host_allocation(size_t i) const {
+            return staging_buffers[i] != VK_NULL_HANDLE ? staging_allocations[i] : storage_allocations[i];
+        }
+    };
+
+    // Ring of FrameCount frames, each with its own command buffer, descriptor
+    // set and storage buffers, so the host fills frame k+1 while the device
+    // still executes frame k. acquire_frame hands out the frames in submission
+    // order and only blocks on a frame that is still in flight, so results come
+    // back FrameCount submissions late. Completion is tracked on D's timeline
+    // semaphore, nothing is reset per frame.
+    //
+    // Device local storage is filled from a staging buffer by a separate upload
+    // command buffer. If D has a transfer queue (get_transfer_queue) the upload
+    // goes there, so the copies of frame k+1 overlap the dispatch of frame k;
+    // the compute submission waits for it on a second timeline semaphore, and
+    // when the transfer queue is of another family the storage buffers are
+    // released and acquired across families, while the staging buffers are
+    // shared concurrently. Readback copies stay on the compute queue.
+    template<class D, uint32_t FrameCount>
+    class frame_ring : public D {
+    public:
+        static constexpr uint32_t frame_count = FrameCount;
+        static_assert(FrameCount > 0);
+
+        frame_ring() :
+            m_timestamp_clock{ get_compute_timestamp_clock(static_cast<D&>(*this)) }
+        {
+            auto sizes = D::get_storage_buffer_sizes();
+            auto buffer_count = static_cast<uint32_t>(sizes.size());
+            auto pool_sizes = get_descriptor_pool_sizes(D::get_shader_reflection(), FrameCount);
+            m_descriptor_pool = D::create_descriptor_pool(FrameCount, std::span<const VkDescriptorPoolSize>{ pool_sizes });
+            if (has_timestamps()) {
+                m_query_pool = D::create_query_pool(VK_QUERY_TYPE_TIMESTAMP, 2 * FrameCount);
+            }
+            bool has_uploads = false;
+            for (uint32_t b = 0; b < buffer_count; b++) {
+                has_uploads |= get_location(b) == storage_location::device_local;
+            }
+            m_host_inputs.assign(buffer_count, true);
+            if (has_uploads) {
+                m_transfer_command_pool = D::create_command_pool(get_transfer_queue_family_index());
+                m_transfer_semaphore = D::create_timeline_semaphore(0);
+            }
+            for (uint32_t i = 0; i < FrameCount; i++) {
+                auto& frame = m_frames[i];
+                frame.index = i;
+                frame.command_buffer = D::allocate_command_buffer(D::get_command_pool());
+                frame.descriptor_set = D::allocate_descriptor_set(m_descriptor_pool, D::get_descriptor_set_layout());
+                frame.first_query = 2 * i;
+                for (uint32_t b = 0; b < buffer_count; b++) {
+                    auto buffer = D::create_buffer(D::get_compute_queue_family_index(), sizes[b],
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                    frame.storage_buffers.push_back(buffer);
+                    frame.storage_allocations.emplace_back(allocate_memory(buffer, b));
+                    auto staging_buffer = VkBuffer{ VK_NULL_HANDLE };
+                    auto staging_allocation = memory_allocation{};
+                    if (get_location(b) == storage_location::device_local) {
+                        // the transfer queue reads it for the upload, the compute
+                        // queue writes it in the readback
+                        auto families = std::array{ D::get_compute_queue_family_index(), get_transfer_queue_family_index() };
+                        staging_buffer = D::create_buffer(families, sizes[b],
+                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+                        staging_allocation = D::allocate_buffer_memory(staging_buffer,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+                    }
+                    frame.staging_buffers.push_back(staging_buffer);
+                    frame.staging_allocations.push_back(staging_allocation);
+                }
+                if (has_uploads) {
+                    frame.upload_command_buffer = D::allocate_command_buffer(m_transfer_command_pool);
+                    record_uploads(frame);
+                }
+            }
+        }
+        frame_ring(const frame_ring&) = delete;
+        frame_ring(frame_ring&&) = delete;
+        ~frame_ring() {
+            // every upload is waited on by a compute submission, so this covers the transfer queue too
+            D::wait_idle();
+            for (auto& frame : m_frames) {
+                for (size_t b = 0; b < frame.storage_buffers.size(); b++) {
+                    D::destroy_buffer(frame.storage_buffers[b]);
+                    D::free(frame.storage_allocations[b]);
+                    if (frame.staging_buffers[b] != VK_NULL_HANDLE) {
+                        D::destroy_buffer(frame.staging_buffers[b]);
+                        D::free(frame.staging_allocations[b]);
+                    }
+                }
+            }
+            if (m_transfer_command_pool != VK_NULL_HANDLE) {
+                D::destroy_command_pool(m_transfer_command_pool);
+                D::destroy_semaphore(m_transfer_semaphore);
+            }
+            if (m_query_pool != VK_NULL_HANDLE) {
+                D::destroy_query_pool(m_query_pool);
+            }
+            D::destroy_descriptor_pool(m_descriptor_pool);
+        }
+        frame_ring& operator=(const frame_ring&) = delete;
+        frame_ring& operator=(frame_ring&&) = delete;
+
+        auto& get_frames() {
+            return m_frames;
+        }
+        bool has_timestamps() const {
+            return m_timestamp_clock.has_timestamps();
+        }
+        auto get_timestamp_query_pool() const {
+            return m_query_pool;
+        }
+
+        // waits for the oldest frame if it is still in flight and makes its storage readable
+        ring_frame& acquire_frame() {
+            auto& frame = m_frames[m_next_frame];
+            m_next_frame = (m_next_frame + 1) % FrameCount;
+            frame.has_results = frame.in_flight;
+            if (frame.in_flight) {
+                D::wait_for_value(frame.submission);
+                frame.in_flight = false;
+                invalidate_frame(frame);
+            }
+            return frame;
+        }
+        void submit_frame(ring_frame& frame) {
+            frame.submission = submit_frame_commands(frame);
+            frame.has_results = false;
+            frame.in_flight = true;
+        }
+        // flushes the frame, submits its upload and compute command buffers and
+        // returns the compute timeline value, without the acquire_frame bookkeeping
+        uint64_t submit_frame_commands(const ring_frame& frame) {
+            flush_frame(frame);
+            if (frame.upload_command_buffer == VK_NULL_HANDLE || !has_host_uploads()) {
+                return D::submit_timeline(frame.command_buffer);
+            }
+            auto upload_signal = make_semaphore_submit_info(m_transfer_semaphore, m_transfer_value + 1, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+            D::queue_submit(get_transfer_queue(), std::span<const VkCommandBuffer>{ &frame.upload_command_buffer, 1 },
+                std::span<const VkSemaphoreSubmitInfo>{}, std::span<const VkSemaphoreSubmitInfo>{ &upload_signal, 1 });
+            m_transfer_value++;
+            auto upload_wait = make_semaphore_submit_info(m_transfer_semaphore, m_transfer_value, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+            return D::submit_timeline(std::span<const VkCommandBuffer>{ &frame.command_buffer, 1 },
+                std::span<const VkSemaphoreSubmitInfo>{ &upload_wait, 1 });
+        }
+        // submit_frame and acquire_frame call these, code that submits frame
+        // command buffers itself has to flush before and invalidate after
+        void flush_frame(const ring_frame& frame) {
+            transfer_frame_memory(frame, true);
+        }
+        void invalidate_frame(const ring_frame& frame) {
+            transfer_frame_memory(frame, false);
+        }
+        // Buffers whose inputs the device writes itself are neither uploaded from
+        // their staging buffer nor acquired from the transfer queue; rerecord
+        // the frame command buffers afterwards. No frame may be in flight.
+        void set_host_inputs(std::vector<bool> host_inputs) {
+            if (host_inputs.size() != m_host_inputs.size()) {
+                throw std::runtime_error{ "host input count does not match storage buffer count" };
+            }
+            if (get_in_flight_count() > 0) {
+                throw std::runtime_error{ "host inputs changed with frames in flight" };
+            }
+            m_host_inputs = std::move(host_inputs);
+            if (m_transfer_command_pool != VK_NULL_HANDLE) {
+                D::reset_command_pool(m_transfer_command_pool);
+                for (auto& frame : m_frames) {
+                    record_uploads(frame);
+                }
+            }
+        }
+        bool is_host_input(size_t i) const {
+            return m_host_inputs[i];
+        }
+        // record into the frame's command buffer before the first access to its storage
+        void record_frame_acquires(command_recorder& recorder, const ring_frame& frame) {
+            if (!needs_ownership_transfer()) {
+                return;
+            }
+            for (size_t b = 0; b < frame.storage_buffers.size(); b++) {
+                if (is_uploaded(frame, b)) {
+                    recorder.buffer_barrier(frame.storage_buffers[b],
+                        VK_PIPELINE_STAGE_2_NONE, 0,
+                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                        get_transfer_queue_family_index(), D::get_compute_queue_family_index());
+                }
+            }
+        }
+        // record into the frame's command buffer after the last kernel, makes the results host readable
+        void record_frame_readbacks(command_recorder& recorder, const ring_frame& frame) {
+            bool has_staging = std::any_of(frame.staging_buffers.begin(), frame.staging_buffers.end(),
+                [](auto buffer) { return buffer != VK_NULL_HANDLE; });
+            if (has_staging) {
+                recorder.memory_barrier(
+                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+                auto sizes = D::get_storage_buffer_sizes();
+                for (size_t b = 0; b < frame.storage_buffers.size(); b++) {
+                    if (frame.staging_buffers[b] != VK_NULL_HANDLE) {
+                        recorder.copy_buffer(frame.storage_buffers[b], frame.staging_buffers[b], sizes[b]);
+                    }
+                }
+            }
+            recorder.memory_barrier(
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+        }
+        // non blocking check whether acquire_frame would wait
+        bool is_next_frame_ready() {
+            auto& frame = m_frames[m_next_frame];
+            return !frame.in_flight || D::is_completed(frame.submission);
+        }
+        // frames still in flight, acquire them this many times to retire everything
+        uint32_t get_in_flight_count() const {
+            return static_cast<uint32_t>(std::count_if(m_frames.begin(), m_frames.end(),
+                [](const auto& frame) { return frame.in_flight; }));
+        }
+        // device time between the frame's two timestamps, valid while has_results is set
+        std::chrono::duration<double, std::nano> get_frame_duration(const ring_frame& frame) {
+            if (!has_timestamps()) {
+                return std::chrono::duration<double, std::nano>{ 0.0 };
+            }
+            auto ticks = D::get_query_pool_results(m_query_pool, frame.first_query, 2);
+            return m_timestamp_clock.get_duration(ticks[0], ticks[1]);
+        }
+    private:
+        storage_location get_location(uint32_t i) {
+            if constexpr (requires(D & d) { d.get_storage_buffer_locations(); }) {
+                return D::get_storage_buffer_locations()[i];
+            }
+            return storage_location::host_visible;
+        }
+        uint32_t get_transfer_queue_family_index() {
+            if constexpr (requires(D & d) { d.get_transfer_queue_family_index(); }) {
+                return D::get_transfer_queue_family_index();
+            }
+            return D::get_compute_queue_family_index();
+        }
+        VkQueue get_transfer_queue() {
+            if constexpr (requires(D & d) { d.get_transfer_queue(); }) {
+                return D::get_transfer_queue();
+            }
+            return D::get_queue();
+        }
+        bool needs_ownership_transfer() {
+            return get_transfer_queue_family_index() != D::get_compute_queue_family_index();
+        }
+        bool is_uploaded(const ring_frame& frame, size_t i) const {
+            return frame.staging_buffers[i] != VK_NULL_HANDLE && m_host_inputs[i];
+        }
+        bool has_host_uploads() const {
+            for (size_t b = 0; b < m_host_inputs.size(); b++) {
+                if (is_uploaded(m_frames[0], b)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        memory_allocation allocate_memory(VkBuffer buffer, uint32_t i) {
+            return allocate_storage_memory(static_cast<D&>(*this), buffer, get_location(i));
+        }
+        // the kernel overwrites its inputs' previous contents only through the
+        // upload, so the buffers are never released back to the transfer family
+        void record_uploads(const ring_frame& frame) {
+            auto recorder = command_recorder{ frame.upload_command_buffer };
+            auto sizes = D::get_storage_buffer_sizes();
+            recorder.begin();
+            for (size_t b = 0; b < frame.storage_buffers.size(); b++) {
+                if (is_uploaded(frame, b)) {
+                    recorder.copy_buffer(frame.staging_buffers[b], frame.storage_buffers[b], sizes[b]);
+                }
+            }
+            if (needs_ownership_transfer()) {
+                for (size_t b = 0; b < frame.storage_buffers.size(); b++) {
+                    if (is_uploaded(frame, b)) {
+                        recorder.buffer_barrier(frame.storage_buffers[b],
+                            VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                            VK_PIPELINE_STAGE_2_NONE, 0,
+                            get_transfer_queue_family_index(), D::get_compute_queue_family_index());
+                    }
+                }
+            }
+            recorder.end();
+        }
+        // flushes before submit or invalidates after completion the non coherent
+        // host memory of one frame, whole allocations are atom aligned already
+        void transfer_frame_memory(const ring_frame& frame, bool flush) {
+            m_ranges.clear();
+            for (size_t b = 0; b < frame.storage_buffers.size(); b++) {
+                auto& allocation = frame.host_allocation(b);
+                if (D::is_non_coherent(allocation.memory_type_index)) {
+                    m_ranges.add(allocation.memory, allocation.offset, allocation.size);
+                }
+            }
+            if (m_ranges.empty()) {
+                return;
+            }
+            if (flush) {
+                D::flush_mapped_memory_ranges(m_ranges.merge());
+            }
+            else {
+                D::invalidate_mapped_memory_ranges(m_ranges.merge());
+            }
+        }
+
+        timestamp_clock m_timestamp_clock;
+        VkDescriptorPool m_descriptor_pool = VK_NULL_HANDLE;
+        VkQueryPool m_query_pool = VK_NULL_HANDLE;
+        VkCommandPool m_transfer_command_pool = VK_NULL_HANDLE;
+        VkSemaphore m_transfer_semaphore = VK_NULL_HANDLE;
+        uint64_t m_transfer_value = 0;
+        std::array<ring_frame, FrameCount> m_frames{};
+        uint32_t m_next_frame = 0;
+        mapped_memory_ranges m_ranges;
+        std::vector<bool> m_host_inputs;
+    };
+
     class first_physical_device : public vulkan_helper::physical_device {
     public:
         first_physical_device() : physical_device{